@@ -18,6 +18,13 @@
 namespace ante {
     struct Compiler;
 
+    /**
+     * Returns the number of bytes a value of type t occupies when passed
+     * to or from JIT-compiled code, including any padding required by the
+     * JIT's data layout.  Unit values occupy no space.
+     */
+    size_t getMarshalledSize(Compiler *c, AnType *t);
+
     /** A data structure for translating between runtime
      * values and TypedValues while jitting. */
     class AnteValue {
@@ -59,6 +66,12 @@ namespace ante {
 
             AnteValue(Compiler *c, TypedValue const& val, parser::Node *expr);
 
+            /**
+             * Constructs an AnteValue from a value already known to be
+             * constant, such as one produced by the InterpretingVisitor.
+             */
+            AnteValue(Compiler *c, TypedValue const& val);
+
             /** Construct an AnteValue using the given pre-initialized data. */
             AnteValue(void *d, AnType *t) : data(d), type(t){}
 
@@ -82,6 +95,9 @@ namespace ante {
             /** Stores a tuple value in data */
             void storeTuple(Compiler *c, TypedValue const& tup);
 
+            /** Stores a fixed-size array value in data */
+            void storeArray(Compiler *c, TypedValue const& arr);
+
             /** Stores a primitive integer, character, or boolean. */
             void storeInt(Compiler *c, TypedValue const& tv);
 
@@ -21,9 +21,21 @@ namespace ante {
     struct TypeDecl;
     struct Module;
     struct TraitImpl;
+    class AnType;
+
+    size_t hashCombine(size_t l, size_t r);
+
+    /** Combine the cached hash of each type in tys */
+    size_t hashAll(std::vector<AnType*> const& tys);
+    size_t hashAll(std::vector<std::string> const& strs);
 
     /**
      * A primitive type
+     *
+     * Every type besides typevars is interned, so two types built from
+     * the same components are the same object and can be compared by
+     * pointer.  Primitives are interned in typeContainer, all other types
+     * in per-kind tables in antype.cpp.
      */
     class AnType {
         // primitive types are uniqued in this container
@@ -31,7 +43,10 @@ namespace ante {
 
     protected:
         AnType(TypeTag id, bool ig) :
-            typeTag(id), isGeneric(ig){}
+            typeTag(id), isGeneric(ig), hash(id){}
+
+        AnType(TypeTag id, bool ig, size_t hash) :
+            typeTag(id), isGeneric(ig), hash(hash){}
 
     public:
         // Initialize typeContainer with all the primitive types
@@ -42,6 +57,11 @@ namespace ante {
         TypeTag typeTag;
         bool isGeneric;
 
+        /** Structural hash computed on construction.  Ignores modifiers,
+         *  typevar names, and array lengths so that any two types equal
+         *  by operator== also have equal hashes. */
+        size_t hash;
+
         // Exact equality
         // Matches typevars to only other typevars of the same name
         bool operator==(AnType const& other) const noexcept;
@@ -116,7 +136,7 @@ namespace ante {
     class AnModifier : public AnType {
         protected:
         AnModifier(const AnType *modifiedType) :
-            AnType(modifiedType->typeTag, modifiedType->isGeneric), extTy(modifiedType){}
+            AnType(modifiedType->typeTag, modifiedType->isGeneric, modifiedType->hash), extTy(modifiedType){}
 
         public:
         const AnType *extTy;
@@ -226,12 +246,9 @@ namespace ante {
         protected:
         AnTupleType(std::vector<AnType*> const& fields,
                     std::vector<std::string> const& fieldNames) :
-                AnType(TT_Tuple, ante::isGeneric(fields)),
+                AnType(TT_Tuple, ante::isGeneric(fields),
+                       hashCombine(hashCombine(TT_Tuple, hashAll(fields)), hashAll(fieldNames))),
                 fields(fields), fieldNames(fieldNames) {}
-
-        AnTupleType(std::vector<AnType*> const& fields,
-                    std::vector<std::string> const& fieldNames, bool isGeneric) :
-                AnType(TT_Tuple, isGeneric), fields(fields), fieldNames(fieldNames) {}
         public:
 
         ~AnTupleType() = default;
@@ -283,7 +300,7 @@ namespace ante {
     class AnArrayType : public AnType {
         protected:
         AnArrayType(AnType* ext, size_t l) :
-            AnType(TT_Array, ext->isGeneric), extTy(ext), len(l) {}
+            AnType(TT_Array, ext->isGeneric, hashCombine(TT_Array, ext->hash)), extTy(ext), len(l) {}
 
         public:
 
@@ -313,7 +330,7 @@ namespace ante {
     class AnPtrType : public AnType {
         protected:
         AnPtrType(AnType *elem) :
-            AnType(TT_Ptr, elem->isGeneric), elemTy(elem){}
+            AnType(TT_Ptr, elem->isGeneric, hashCombine(TT_Ptr, elem->hash)), elemTy(elem){}
 
         public:
 
@@ -337,7 +354,9 @@ namespace ante {
     };
 
     /** A Typevar type.
-     *  Typevar types are always generic. */
+     *  Typevar types are always generic.
+     *  Unlike other types these are not interned since unification
+     *  distinguishes typevars by identity rather than by name. */
     class AnTypeVarType : public AnType {
         protected:
         AnTypeVarType(std::string const& n) :
@@ -370,7 +389,8 @@ namespace ante {
         protected:
         AnFunctionType(AnType *ret, std::vector<AnType*> params,
                 std::vector<TraitImpl*> tcConstraints)
-                : AnType(TT_Function, ante::isGeneric(ret, params, tcConstraints)),
+                : AnType(TT_Function, ante::isGeneric(ret, params, tcConstraints),
+                         hashCombine(hashCombine(TT_Function, ret->hash), hashAll(params))),
                   paramTys(params), retTy(ret), typeClassConstraints(tcConstraints){
         }
 
@@ -423,7 +443,8 @@ namespace ante {
 
         protected:
         AnDataType(std::string const& n, TypeArgs const& args, TypeDecl *decl) :
-                AnType(TT_Data, false), name(n), unboundType(0), typeArgs(args), decl(decl){}
+                AnType(TT_Data, false, hashCombine(hashCombine(TT_Data, std::hash<std::string>()(n)), hashAll(args))),
+                name(n), unboundType(0), typeArgs(args), decl(decl){}
 
         public:
 
@@ -466,7 +487,6 @@ namespace ante {
         llvm::Value* getTagValue(Compiler *c, std::string const& variantName, std::vector<TypedValue> const& args) const;
     };
 
-    size_t hashCombine(size_t l, size_t r);
     bool allEq(std::vector<AnType*> const& l, std::vector<AnType*> const& r);
     bool allApproxEq(std::vector<AnType*> const& l, std::vector<AnType*> const& r);
 }
@@ -11,17 +11,24 @@ namespace ante {
      * For detail on each option, see the output of $ ante -help
      */
     enum Args {
+        CacheDir,
+        CacheSize,
         Check,
         CompileAndRun,
         CompileToObj,
+        CtfeJitThreshold,
         EmitLLVM,
         Eval,
+        FullLTO,
         Help,
+        Jobs,
         Lib,
         NoColor,
         OptLvl,
         OutputName,
         Parse,
+        PurgeCache,
+        ThinLTO,
         Time
     };
 
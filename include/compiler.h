@@ -5,12 +5,15 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
-#include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
 
 #include <string>
 #include <memory>
 #include <list>
+#include <map>
+#include <tuple>
 
 #include "args.h"
 #include "parser.h"
@@ -21,6 +24,9 @@
 #include "antevalue.h"
 #include "typedvalue.h"
 #include "unification.h"
+#include "jit.h"
+#include "objcache.h"
+#include "session.h"
 
 #define AN_MANGLED_SELF "_$self$"
 
@@ -68,6 +74,94 @@ namespace ante {
     };
 
 
+    /**
+     * @brief The concrete types bound to each type variable while monomorphising
+     *
+     * Bindings are kept in a hash map keyed on the type variable, so lookups are
+     * constant time regardless of how many functions have been monomorphised.
+     * Each monomorphised function pushes a frame before binding its own type
+     * variables and pops it once its body is compiled, undoing every binding made
+     * within the frame so that they cannot leak into another instantiation.
+     */
+    class MonomorphisationBindings {
+        llvm::DenseMap<const AnType*, AnType*> bindings;
+
+        /** Each binding made along with the binding it shadowed, or nullptr */
+        std::vector<std::pair<const AnType*, AnType*>> undoLog;
+
+        /** Size of the undoLog when each frame was pushed */
+        std::vector<size_t> frames;
+
+        public:
+            void push();
+            void pop();
+
+            /** Bind typeVar to type in the current frame, shadowing any previous binding */
+            void bind(AnType *typeVar, AnType *type);
+
+            /** Bind each non-trivial (typevar, type) pair of subs in the current frame */
+            void bind(Substitutions const& subs);
+
+            /** Return the type typeVar is bound to, or nullptr if it is unbound */
+            AnType* lookup(const AnType *typeVar) const;
+
+            /** Replace each bound type variable in t, recursively */
+            AnType* apply(AnType *t, int recursionLimit = 10000) const;
+    };
+
+    /**
+     * @brief The lowered llvm type and size in bits of a monomorphic AnType
+     *
+     * Each is filled in the first time it is needed.
+     */
+    struct TypeLayout {
+        llvm::Type *llvmType = nullptr;
+        size_t sizeInBits = 0;
+        bool hasSize = false;
+    };
+
+    /**
+     * @brief Allocates the stack slots of the function being compiled
+     *
+     * Every slot is an alloca in the entry block of its function so that
+     * mem2reg and SROA can promote it even when it is only used within a loop.
+     * Slots that only need to live as long as the innermost block are also
+     * marked with llvm.lifetime.start/end and are handed out again to later,
+     * disjoint blocks needing a slot of the same type once their block ends.
+     * A slot whose address is taken lives until the end of its function.
+     */
+    class StackSlots {
+        /** Slots whose scope has ended, by type */
+        llvm::DenseMap<llvm::Type*, std::vector<llvm::AllocaInst*>> freeSlots;
+
+        /** The slots used by each open scope */
+        std::vector<std::vector<llvm::AllocaInst*>> scopes;
+
+        public:
+            /** Create a slot that lives as long as the current function */
+            llvm::AllocaInst* create(llvm::IRBuilder<> &builder, llvm::Type *type, llvm::Twine const& name = "");
+
+            /**
+             * Return a slot that lives until the innermost scope ends, reusing
+             * a free slot if there is one.  Outside of any scope this is create.
+             */
+            llvm::AllocaInst* createScoped(llvm::IRBuilder<> &builder, llvm::Type *type, llvm::Twine const& name = "");
+
+            /**
+             * Keep a scoped slot alive until the end of its function rather than
+             * its scope, for when its address is taken and may escape the scope.
+             */
+            void escape(llvm::AllocaInst *slot);
+
+            void pushScope();
+
+            /**
+             * End the innermost scope, freeing its slots for reuse.  A slot that
+             * result was loaded from is kept alive since it is still used afterward.
+             */
+            void popScope(llvm::IRBuilder<> &builder, llvm::Value *result = nullptr);
+    };
+
     /**
      * @brief Contains state information on the module being compiled
      */
@@ -75,8 +169,25 @@ namespace ante {
         //Stack of each called function
         std::vector<FuncDecl*> callStack;
 
-        //Map of typevar names to concrete types whenever a generic funcion is monomorphised
-        Substitutions monomorphisationMappings;
+        //Concrete types of each typevar of the generic functions currently being monomorphised
+        MonomorphisationBindings monomorphisationBindings;
+
+        //Each instance of a generic function already compiled into this module,
+        //keyed by its definition and the concrete signature, without trait constraints,
+        //that it was instantiated with
+        llvm::DenseMap<std::pair<FuncDecl*, AnType*>, TypedValue> instances;
+
+        //Layout of each monomorphic type lowered or sized so far.  These never depend
+        //on the monomorphisation bindings so they only need to be computed once.
+        llvm::DenseMap<const AnType*, TypeLayout> typeLayouts;
+
+        //Number of calls to monomorphise that reused or compiled an instance, shown under -time
+        size_t instancesReused = 0;
+        size_t instancesCompiled = 0;
+
+        //Private constant global of each aggregate produced by compile-time evaluation.
+        //Constants are uniqued by llvm so equal results share a single global.
+        llvm::DenseMap<llvm::Constant*, llvm::GlobalVariable*> constantGlobals;
 
         //the continue and break labels of each for/while loop to jump out of
         //the pointer is swapped/nullified when a function is called to prevent
@@ -84,15 +195,48 @@ namespace ante {
         std::unique_ptr<std::vector<llvm::BasicBlock*>> continueLabels;
         std::unique_ptr<std::vector<llvm::BasicBlock*>> breakLabels;
 
-        CompilerCtxt() : callStack(), continueLabels(new std::vector<llvm::BasicBlock*>()), breakLabels(new std::vector<llvm::BasicBlock*>()){}
+        //stack slots of the function being compiled, swapped out along with
+        //the labels above whenever another function is compiled
+        std::unique_ptr<StackSlots> stackSlots;
 
-        void insertMonomorphisationMappings(Substitutions const& subs){
-            for(auto &sub : subs){
-                if(sub.first != sub.second){
-                    monomorphisationMappings.push_back(sub);
-                }
-            }
-        }
+        CompilerCtxt() : callStack(), continueLabels(new std::vector<llvm::BasicBlock*>()), breakLabels(new std::vector<llvm::BasicBlock*>()),
+            stackSlots(new StackSlots()){}
+    };
+
+    /**
+     * @brief Results of compile-time calls to pure functions
+     *
+     * Each result is kept in its marshalled form, keyed by the called function
+     * along with the types and marshalled bytes of its arguments, so a repeated
+     * call can be converted back with AnteValue::asTypedValue instead of being
+     * JIT-compiled and run again.
+     */
+    class CtfeCache {
+        using Key = std::tuple<FuncDecl*, std::vector<AnType*>, std::string>;
+
+        std::map<Key, std::string> results;
+
+        /** Whether each function was proven pure, filled in by isPure */
+        llvm::DenseMap<llvm::Function*, bool> purity;
+
+        public:
+            /** Statistics reported under -time */
+            size_t hits = 0;
+            size_t misses = 0;
+
+            /** Return true if fd was marked with ![pure] or its body can be proven pure */
+            bool isPure(FuncDecl *fd);
+
+            /**
+             * Return true if f only writes to its own stack slots, only reads
+             * from those or constant globals, and only calls pure functions.
+             */
+            bool isPure(llvm::Function *f);
+
+            /** Return the marshalled result of a previous call, or nullptr if there is none */
+            const std::string* lookup(FuncDecl *fd, std::vector<AnType*> const& argTys, std::string const& args);
+
+            void store(FuncDecl *fd, std::vector<AnType*> const& argTys, std::string const& args, std::string const& result);
     };
 
     /**
@@ -105,14 +249,43 @@ namespace ante {
         /** @brief arguments to current ante function being called.
          * Will be empty if !isJIT */
         std::vector<TypedValue> args;
+
+        /** @brief memoized results of compile-time calls, shared with imported modules */
+        CtfeCache ctfeCache;
+
+        /** @brief whether the InterpretingVisitor supports the body of each function checked so far */
+        llvm::DenseMap<FuncDecl*, bool> interpretable;
+
+        /** @brief interpretable functions which may call the compiler API.  These are never JIT-compiled */
+        llvm::SmallPtrSet<FuncDecl*, 8> callsCompilerApi;
+
+        /** @brief number of times each function was called by the InterpretingVisitor */
+        llvm::DenseMap<FuncDecl*, unsigned> interpretedCalls;
+
+        /** @brief compile-time calls to a function are JIT-compiled once it has been
+         * interpreted this many times.  Set with -ctfe-jit-threshold */
+        unsigned jitThreshold = 32;
+
+        /** @brief number of compile-time calls evaluated by each tier, shown under -time */
+        size_t callsInterpreted = 0;
+        size_t callsJitted = 0;
     };
 
+    /** Link-time optimization mode selected with -flto=thin or -flto=full */
+    enum class LtoMode { None, Thin, Full };
+
     /**
      * @brief An Ante compiler responsible for a single module
      */
     struct Compiler {
+        /** The session this Compiler was created in.  It is made current
+         *  whenever the Compiler is used, possibly from another thread. */
+        CompilationSession *session;
         std::shared_ptr<llvm::LLVMContext> ctxt;
-        std::unique_ptr<llvm::ExecutionEngine> jit;
+        /** JIT for compile-time code, shared with the Compilers of imported modules */
+        std::shared_ptr<JitSession> jit;
+        /** Cache of previously emitted object files, or nullptr if -cache-dir was not given */
+        std::shared_ptr<ObjectCache> objectCache;
         std::unique_ptr<llvm::Module> module;
         llvm::IRBuilder<> builder;
 
@@ -121,7 +294,7 @@ namespace ante {
         /** The abstract syntax tree.
          *  This is gradually filled with more information
          *  during each compilation phase. */
-        parser::RootNode* ast;
+        parser::RootNode* ast = nullptr;
 
         std::unique_ptr<CompilerCtxt> compCtxt;
 
@@ -131,6 +304,12 @@ namespace ante {
         std::string fileName, outFile, funcPrefix;
         unsigned int scope, optLvl, fnScope;
 
+        /** Number of partitions the module is split into when emitting an executable */
+        unsigned int codegenThreads;
+
+        /** If set, modules are emitted as bitcode and optimized together when linked */
+        LtoMode ltoMode;
+
         /**
         * @brief The main constructor for Compiler
         *
@@ -159,6 +338,12 @@ namespace ante {
         /** @brief Compiles a native binary */
         void compileNative();
 
+        /**
+        * @brief Returns the key of this module in objectCache, or an empty
+        *        string if there is no cache or the module is already compiled.
+        */
+        std::string getCacheKey() const;
+
         /**
         * @brief Compiles a module to an object file
         *
@@ -200,8 +385,9 @@ namespace ante {
         *        the command line arguments
         *
         * @param args The command line arguments
+        * @param run If false, the executable is not run even if -r is given
         */
-        void processArgs(CompilerArgs *args);
+        void processArgs(CompilerArgs *args, bool run = true);
 
 
         /**
@@ -309,18 +495,55 @@ namespace ante {
         */
         int compileIRtoObj(llvm::Module *mod, std::string outFile);
 
+        /**
+        * @brief Splits a module into partitions and compiles each into its
+        *        own obj file on a separate thread.
+        *
+        * @param mod The already-compiled module
+        * @param outFile Prefix of the name of each file to output
+        * @param partitions The maximum number of partitions to split mod into
+        *
+        * @return The name of each obj file written, or an empty vector on error
+        */
+        std::vector<std::string> compileIRtoObjs(llvm::Module *mod, std::string const& outFile, unsigned partitions);
+
+        /**
+        * @brief Writes a module as bitcode to be optimized and compiled by linkLto.
+        *        With ThinLTO the bitcode also contains a summary of the module.
+        *
+        * @param mod The already-compiled module
+        * @param outFile Name of the file to output
+        *
+        * @return 0 on success
+        */
+        int compileIRtoBitcode(llvm::Module *mod, std::string const& outFile);
+
         TypedValue getUnitLiteral();
 
         /**
         * @brief Invokes the linker specified by AN_LINKER (in target.h) to
-        *        link each object file
+        *        link each object file, removing any unused sections
         *
-        * @param inFiles String containing each obj file to link separated with spaces
+        * @param inFiles Name of each obj file to link
         * @param outFile Name of the file to output
         *
         * @return 0 on success
         */
-        static int linkObj(std::string inFiles, std::string outFile);
+        static int linkObj(std::vector<std::string> const& inFiles, std::string const& outFile);
+
+        /**
+        * @brief Optimizes the bitcode files written with -flto as a whole
+        *        program, then compiles them to obj files and links those with linkObj
+        *
+        * @param inFiles Name of each bitcode file to link
+        * @param outFile Name of the file to output
+        * @param optLvl Optimization level used for the whole program
+        * @param threads Number of threads used for code generation
+        *
+        * @return 0 on success
+        */
+        static int linkLto(std::vector<std::string> const& inFiles, std::string const& outFile,
+                unsigned int optLvl, unsigned int threads);
     };
 
     /*
@@ -328,6 +551,42 @@ namespace ante {
      */
     TypedValue addrOf(Compiler *c, TypedValue &tv);
 
+    /*
+     * @brief Return the stack slot v was loaded from, if any
+     */
+    llvm::AllocaInst* getLoadedSlot(llvm::Value *v);
+
+    /*
+     * @brief Returns the read-only global holding an array, tuple, or data type
+     *        constant resulting from compile-time evaluation, emitting it if needed.
+     *        A load of such a global gives the global itself.  Any other value is
+     *        returned unchanged.
+     */
+    TypedValue getCtConstantGlobal(Compiler *c, TypedValue const& tv);
+
+    /*
+     * @brief Returns a load of the global given by getCtConstantGlobal, or tv
+     *        unchanged if there is none.
+     */
+    TypedValue loadCtConstant(Compiler *c, TypedValue const& tv);
+
+    /*
+     * @brief True if v is a global created by getCtConstantGlobal
+     */
+    bool isCtConstantGlobal(Compiler *c, llvm::Value *v);
+
+    /*
+     * @brief Returns v if it is constant, or the initializer of v or of the value
+     *        loaded by v if it is a global created by getCtConstantGlobal.
+     *        Otherwise returns nullptr.
+     */
+    llvm::Constant* getCtConstant(Compiler *c, llvm::Value *v);
+
+    /*
+     * @brief Compiles a builtin arithmetic or comparison operator on two values of the same numeric type
+     */
+    TypedValue handlePrimitiveNumericOp(int opToken, Compiler *c, TypedValue const& lhs, TypedValue const& rhs);
+
 
     /**
     *  Compile a compile-time function/macro which should not return a function call, just a compile-time constant.
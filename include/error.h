@@ -8,6 +8,7 @@ namespace ante { namespace parser { struct Node; } }
 
 #include "yyparser.h"
 #include "lazystr.h"
+#include "sourceloc.h"
 
 namespace ante {
 
@@ -24,18 +25,21 @@ namespace ante {
     struct TypeVarError : public CtError {};
 
     /** General error function.  Show an error and the line it is on, and throw an exception. */
-    void error(const char* msg, const yy::location& loc, ErrorType t = ErrorType::Error);
+    void error(const char* msg, LOC_TY const& loc, ErrorType t = ErrorType::Error);
 
-    void error(lazy_printer msg, const yy::location& loc, ErrorType t = ErrorType::Error);
+    void error(lazy_printer msg, LOC_TY const& loc, ErrorType t = ErrorType::Error);
 
     /** Show an error and the line it is on, but do not throw an exception. */
-    void showError(lazy_printer msg, const yy::location& loc, ErrorType t = ErrorType::Error);
+    void showError(lazy_printer msg, LOC_TY const& loc, ErrorType t = ErrorType::Error);
 
     /** Return the number of errors issued, omitting warnings and notes */
     size_t errorCount();
 
-    /** Return an empty yy::location for when the error location is unknown or internal */
-    yy::location unknownLoc();
+    /** Return the stream errors are printed to in the current CompilationSession */
+    std::ostream& diagnostics();
+
+    /** Return an empty location for when the error location is unknown or internal */
+    LOC_TY unknownLoc();
 }
 
 #endif
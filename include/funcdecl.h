@@ -29,6 +29,9 @@ namespace ante {
         /** True if this is a decl from a trait, used as a flag to swap with impl later */
         bool traitFuncDecl = false;
 
+        /** True if marked with ![pure], allowing compile-time calls to it to be memoized */
+        bool isPure = false;
+
         parser::FuncDeclNode* getFDN() const noexcept {
             return static_cast<parser::FuncDeclNode*>(this->definition);
         }
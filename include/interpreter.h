@@ -0,0 +1,71 @@
+#ifndef AN_INTERPRETER_H
+#define AN_INTERPRETER_H
+
+#include <llvm/ADT/DenseMap.h>
+#include "compiler.h"
+
+namespace ante {
+
+    /**
+     * Evaluates compile-time code by walking its typed parse tree
+     * rather than compiling it to a function and running it in the JIT.
+     * Every value produced is an llvm::Constant so a result can be used
+     * in place of the expression it was evaluated from.
+     *
+     * Only a small subset of the language is supported: literals, tuples,
+     * primitive arithmetic and comparisons, let bindings, if expressions,
+     * calls to the compiler API (Ante.*), and calls to functions made up of
+     * only these.  Anything else is left to the JIT, as are calls to any
+     * function interpreted more than CompilerCtCtxt::jitThreshold times.
+     */
+    struct InterpretingVisitor : public NodeVisitor {
+        TypedValue val;
+        Compiler *c;
+
+        InterpretingVisitor(Compiler *cc) : c(cc){}
+        virtual ~InterpretingVisitor(){}
+
+        /**
+         * Evaluate n if it can be interpreted.
+         *
+         * @return The constant value of n, or an empty TypedValue if n
+         *         must be compiled and run in the JIT instead.
+         */
+        static TypedValue tryInterpret(Compiler *c, parser::Node *n);
+
+        /**
+         * Evaluate a call to fd with the given constant arguments
+         * if fd can be interpreted.
+         *
+         * @return The constant result of the call, or an empty TypedValue
+         *         if fd must be compiled and run in the JIT instead.
+         */
+        static TypedValue tryInterpret(Compiler *c, FuncDecl *fd, std::vector<TypedValue> const& args);
+
+        /** Call a compiler API function with the given constant arguments. */
+        static TypedValue callCompilerApi(Compiler *c, FuncDecl *fd,
+                std::vector<TypedValue> const& args, LOC_TY const& loc);
+
+        DECLARE_NODE_VISIT_METHODS();
+
+    private:
+        using Bindings = llvm::DenseMap<Declaration*, TypedValue>;
+
+        /** Values of the parameters and let bindings of the function being evaluated */
+        Bindings bindings;
+
+        /** Number of interpreted calls currently on the stack */
+        size_t depth = 0;
+
+        /** Set once a compiler API call has run.  From then on evaluation
+         * is never abandoned for the JIT, which would run the call again. */
+        bool hadSideEffects = false;
+
+        TypedValue call(FuncDecl *fd, std::vector<TypedValue> const& args, LOC_TY &loc);
+
+        /** Abandon evaluation so the caller can fall back to the JIT */
+        void bailout();
+    };
+}
+
+#endif /* end of include guard: AN_INTERPRETER_H */
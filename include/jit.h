@@ -0,0 +1,102 @@
+#ifndef AN_JIT_H
+#define AN_JIT_H
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ADT/StringSet.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace ante {
+    /**
+     * Stores the objects compiled by a JitSession in the -cache-dir
+     * directory so compile-time code that has not changed is loaded
+     * instead of compiled again by later invocations of the compiler.
+     *
+     * Entries are keyed by the module identifier, which the JitSession
+     * sets to a hash of the module's bitcode and target triple before
+     * compiling it.  They share the llvmcache- prefix of the ObjectCache
+     * so both are pruned together by -cache-size.
+     */
+    class JitObjectCache : public llvm::ObjectCache {
+        std::string dir;
+
+        std::string getObjPath(const llvm::Module *module) const;
+
+        public:
+            size_t hits;
+            size_t misses;
+
+            JitObjectCache(std::string const& dir);
+
+            void notifyObjectCompiled(const llvm::Module *module, llvm::MemoryBufferRef obj) override;
+
+            std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *module) override;
+    };
+
+    /**
+     * A long-lived ORC JIT used to run compile-time (ante) code.
+     *
+     * One session is shared between a Compiler and the Compilers of
+     * the modules it imports.  Each call to addModuleAndLookup only adds
+     * definitions the JIT has not seen yet as a new incremental module.
+     * Anything already materialized, such as the prelude, is linked
+     * against by name instead of being cloned and compiled again.
+     */
+    class JitSession {
+        std::unique_ptr<llvm::orc::LLLazyJIT> jit;
+
+        /** Owns the context that each module added to the JIT is loaded into. */
+        llvm::orc::ThreadSafeContext tsctxt;
+
+        /** Names of each externally visible definition already added to the JIT. */
+        llvm::StringSet<> definitions;
+
+        /** Used to give each entry function a unique symbol name. */
+        size_t entryCount;
+
+        /** Set by setCacheDir.  When present, each module is compiled eagerly
+         *  through the cache rather than lazily by the JIT. */
+        std::unique_ptr<JitObjectCache> objectCache;
+        std::unique_ptr<llvm::TargetMachine> targetMachine;
+
+        /** Created by getDataLayout, possibly before the JIT itself */
+        std::unique_ptr<llvm::DataLayout> dataLayout;
+
+        /** Create the underlying LLLazyJIT.  Deferred until the first module
+         *  is added since most compilations never evaluate anything. */
+        void init();
+
+        public:
+            /** Statistics reported under -time */
+            size_t modulesAdded;
+            size_t definitionsAdded;
+            size_t definitionsReused;
+            std::chrono::nanoseconds timeSpent;
+
+            JitSession();
+
+            /** Cache the code compiled by this session in dir, see JitObjectCache */
+            void setCacheDir(std::string const& dir);
+
+            /** The layout of values in memory shared with JIT-compiled code */
+            llvm::DataLayout const& getDataLayout();
+
+            /**
+             * Add every definition in module that is new to the JIT, along
+             * with entry which is always added under a fresh name.
+             * Functions that are still being compiled, eg. main, are left
+             * as declarations.
+             *
+             * @return The address of entry, or nullptr on failure.
+             */
+            void* addModuleAndLookup(llvm::Module const& module, llvm::Function *entry);
+
+            /** Print the statistics above to stdout. */
+            void printStatistics() const;
+    };
+}
+
+#endif /* end of include guard: AN_JIT_H */
@@ -66,6 +66,9 @@ namespace ante {
 //define a basic lazy_str type to contain the string
 //to print and the OS dependent color/formatting to print it in
 namespace ante {
+    /** False if colored output was disabled for the current CompilationSession */
+    bool coloredOutput();
+
     struct lazy_str {
         std::string s;
         AN_COLOR_TYPE fmt;
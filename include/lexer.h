@@ -7,6 +7,9 @@
 #include <fstream>
 #include <stack>
 #include <map>
+#include <memory>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
 
 namespace ante { namespace parser { struct Node; } }
 #ifndef YYSTYPE
@@ -20,8 +23,6 @@ namespace ante { namespace parser { struct Node; } }
 #define IS_WHITESPACE(c) (c == ' ' || c == '\t' || c == '\n' || c == 13) // || c == 130
 
 namespace ante{
-    extern bool colored_output;
-
     class Lexer{
     public:
         std::string *fileName;
@@ -40,13 +41,12 @@ namespace ante{
         unsigned int getManualScopeLevel() const;
 
     private:
-        /* the ifstream to take from */
-        std::istream *in;
+        /* Contents of the source file, memory-mapped when it is large enough.
+         * Null for pseudo-files, which are lexed straight from their string */
+        std::unique_ptr<llvm::MemoryBuffer> source;
 
-        /* If this is set to true then the psuedoFile string should be parsed
-         * as a string containing ante src code.  Used for Str interpolation */
-        bool isPseudoFile;
-        char* pseudoFile;
+        /* Location of nxt in the buffer being lexed and the end of that buffer */
+        const char *pos, *end;
 
         /* How many ${  } block's are we in? If >1 then convert } to Tok_InterpolateEnd */
         unsigned int interpolationLevel;
@@ -98,10 +98,13 @@ namespace ante{
 
         void lexErr(const char *msg, yy::parser::location_type* loc);
 
+        void loadBuffer(const char *begin, const char *end);
         void incPos(void);
         void incPos(int end);
+        const char* curPtr() const;
         yy::position getPos(bool inclusiveEnd = true) const;
 
+        void setlextxt(const char *str, size_t len);
         void setlextxt(std::string &str);
         int handleComment(yy::parser::location_type* loc);
         int handlePossibleScopeChange();
@@ -119,7 +122,8 @@ namespace ante{
 }
 
 
-extern ante::Lexer *yylexer;
+/* Returns the lexer of the current CompilationSession */
+ante::Lexer* getLexer();
 void setLexer(ante::Lexer *l);
 
 #endif
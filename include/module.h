@@ -3,6 +3,7 @@
 
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <llvm/ADT/StringMap.h>
 #include "funcdecl.h"
 #include "typedecl.h"
@@ -14,6 +15,30 @@ namespace ante {
 
     using TypeArgs = std::vector<AnType*>;
 
+    /** Hashes a list of interned types by their identity */
+    struct TypeArgsHash {
+        size_t operator()(TypeArgs const& args) const;
+    };
+
+    /**
+     * Every impl of a single trait that is visible from a module,
+     * bucketed by the head type constructors of its type arguments
+     * so that a lookup only tries to unify with impls that could match.
+     */
+    struct TraitImplIndex {
+        /** Each visible impl in lookup order: the module's own impls then each import's */
+        std::vector<TraitImpl*> impls;
+
+        /** Indices into impls keyed by the head constructors of their type arguments */
+        std::unordered_map<size_t, std::vector<size_t>> byHead;
+
+        /** Indices of impls with a type variable as a head; these may match any type */
+        std::vector<size_t> generic;
+
+        /** Previous results of lookups keyed by their (interned) type arguments */
+        std::unordered_map<TypeArgs, TraitImpl*, TypeArgsHash> resolved;
+    };
+
     /**
      * A virtual filesystem tree node containing information on
      * types, functions, imports, and traits of the current module.
@@ -63,6 +88,14 @@ namespace ante {
         /** The submodules of the current node */
         llvm::StringMap<Module> children;
 
+        /** Lazily built index of traitImpls merged with each import's, keyed by trait name */
+        mutable llvm::StringMap<TraitImplIndex> traitImplIndices;
+
+        /** The value of CompilationSession::implsAdded when traitImplIndices was last valid */
+        mutable size_t traitImplIndicesVersion = 0;
+
+        TraitImplIndex& getTraitImplIndex(std::string const& name) const;
+
         public:
             Module(std::string const& name) : name{name} {}
             ~Module() = default;
@@ -84,6 +117,12 @@ namespace ante {
             /** Lookup the given TraitInstance* and return it if found, null otherwise */
             TraitImpl* lookupTraitImpl(std::string const& name, TypeArgs const& typeArgs) const;
 
+            /** Register an impl of the trait with the given name in this module */
+            void addTraitImpl(std::string const& name, TraitImpl *impl);
+
+            /** Add the given module to this module's imports */
+            void addImport(Module *import);
+
             /** Lookup the TraitDecl and return a new, unimplemented instance of it */
             TraitImpl* freshTraitImpl(std::string const& name) const;
 
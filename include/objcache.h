@@ -0,0 +1,80 @@
+#ifndef AN_OBJCACHE_H
+#define AN_OBJCACHE_H
+
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ante {
+    /** Identifies the running compiler binary so rebuilding it invalidates every cache entry */
+    std::string const& compilerIdentity();
+
+    /**
+     * Write contents to dest within the cache directory dir, creating dir
+     * if needed.  The file is never seen partially written by another
+     * compilation.  Returns true on success.
+     */
+    bool writeCacheEntry(std::string const& dir, std::string const& dest, llvm::StringRef contents);
+
+    /**
+     * An on-disk cache of the object files emitted for each module,
+     * enabled with -cache-dir.
+     *
+     * Entries are keyed by the source of the module, the compiler
+     * binary, the target, and each flag that changes the generated code.
+     * Each entry also records every file read while compiling it (the
+     * module's transitive imports and the prelude) along with a hash of
+     * their contents.  An entry is only used if none of these files have
+     * changed since it was stored.
+     *
+     * All files are named llvmcache-* so the directory can be pruned by
+     * llvm::pruneCache, which removes the least recently used entries
+     * once the cache grows past its size limit.
+     */
+    class ObjectCache {
+        std::string dir;
+
+        /** Maximum size of the cache directory in bytes, or 0 for no limit */
+        uint64_t maxSizeBytes;
+
+        std::string getManifestPath(std::string const& key) const;
+        std::string getObjPath(std::string const& key, size_t index) const;
+
+        public:
+            ObjectCache(std::string const& dir, uint64_t maxSizeBytes);
+
+            /**
+             * Return the key of the module compiled from fileName with the
+             * given command-line options, or an empty string if the file
+             * cannot be read.
+             */
+            std::string getKey(std::string const& fileName, std::string const& options) const;
+
+            /**
+             * Return the paths of the cached object files stored under key.
+             * If there is no entry, or any file it depends on has changed
+             * since it was stored, an empty vector is returned instead.
+             */
+            std::vector<std::string> lookup(std::string const& key) const;
+
+            /**
+             * Copy each object file into the cache under key.  The entry
+             * is valid as long as the contents of each dependency are unchanged.
+             */
+            void store(std::string const& key, std::vector<std::string> const& objFiles,
+                    std::vector<const std::string*> const& dependencies) const;
+
+            /** Print the number of hits and misses of every cache in this process to stdout. */
+            static void printStatistics();
+
+            /**
+             * Remove every entry stored in dir, including the JIT-compiled
+             * code of compile-time functions.  Used by -purge-cache.
+             */
+            static void purge(std::string const& dir);
+    };
+}
+
+#endif /* end of include guard: AN_OBJCACHE_H */
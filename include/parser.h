@@ -6,13 +6,10 @@
 #include "lexer.h"
 #include "tokens.h"
 #include "location.hh"
+#include "sourceloc.h"
 #include "nodevisitor.h"
 #include "declaration.h"
 
-#ifndef LOC_TY
-#  define LOC_TY yy::location
-#endif
-
 namespace ante {
 
     /* forward-decls from {compiler.h, declaration.h, antype.h} */
@@ -26,7 +23,7 @@ namespace ante {
 
         /* Needed for compliancy with several versions of bison */
         yy::position mkPos(std::string *f, unsigned int line, unsigned int col);
-        LOC_TY mkLoc(yy::position begin, yy::position end);
+        yy::location mkLoc(yy::position begin, yy::position end);
 
 
         enum ParseErr{
@@ -52,7 +49,14 @@ namespace ante {
             bool operator!=(NodeIterator<T> r){ return cur != r.cur; }
         };
 
-        /* Base class for all nodes */
+        /*
+         * Base class for all nodes
+         *
+         * Nodes are allocated from the nodeArena of the current CompilationSession
+         * so that a parse tree, whose siblings are allocated one after another,
+         * stays mostly contiguous in memory.  Deleting a node still runs its
+         * destructor but its memory is only reclaimed along with the session.
+         */
         struct Node{
             typedef NodeIterator<const Node> const_iterator;
             typedef const Node* const_pointer;
@@ -78,8 +82,17 @@ namespace ante {
 
             LOC_TY& getLoc() noexcept { return loc; }
 
-            Node(LOC_TY& l) : next{nullptr}, loc{l}, type{nullptr}{}
-            virtual ~Node(){}
+            Node(LOC_TY const& l) : next{nullptr}, loc{l}, type{nullptr}{}
+
+            /* Destroy the rest of the sibling list iteratively rather than
+             * recursing once for each node in a long statement list */
+            virtual ~Node(){
+                auto n = std::move(next);
+                while(n) n = std::move(n->next);
+            }
+
+            static void* operator new(size_t size);
+            static void operator delete(void*){}
 
             private:
                 AnType *type;
@@ -99,7 +112,7 @@ namespace ante {
              * parent node is initialized, so it is required
              * in the constructor (unlike next and prev)
              */
-            ModifiableNode(LOC_TY& loc) : Node(loc){}
+            ModifiableNode(LOC_TY const& loc) : Node(loc){}
             ~ModifiableNode(){}
 
             bool hasModifier(int mod) const;
@@ -118,7 +131,7 @@ namespace ante {
 
             /** Merge all contents of rn into this RootNode */
             void merge(const RootNode *rn);
-            RootNode(LOC_TY& loc) : Node(loc){}
+            RootNode(LOC_TY const& loc) : Node(loc){}
             ~RootNode(){}
         };
 
@@ -127,7 +140,7 @@ namespace ante {
             std::string val;
             TypeTag typeTag;
             void accept(NodeVisitor& v){ v.visit(this); }
-            IntLitNode(LOC_TY& loc, std::string s, TypeTag ty) : Node(loc), val(s), typeTag(ty){}
+            IntLitNode(LOC_TY const& loc, std::string s, TypeTag ty) : Node(loc), val(s), typeTag(ty){}
             ~IntLitNode(){}
         };
 
@@ -135,28 +148,28 @@ namespace ante {
             std::string val;
             TypeTag typeTag;
             void accept(NodeVisitor& v){ v.visit(this); }
-            FltLitNode(LOC_TY& loc, std::string s, TypeTag ty) : Node(loc), val(s), typeTag(ty){}
+            FltLitNode(LOC_TY const& loc, std::string s, TypeTag ty) : Node(loc), val(s), typeTag(ty){}
             ~FltLitNode(){}
         };
 
         struct BoolLitNode : public Node{
             bool val;
             void accept(NodeVisitor& v){ v.visit(this); }
-            BoolLitNode(LOC_TY& loc, char b) : Node(loc), val((bool) b){}
+            BoolLitNode(LOC_TY const& loc, char b) : Node(loc), val((bool) b){}
             ~BoolLitNode(){}
         };
 
         struct CharLitNode : public Node{
             char val;
             void accept(NodeVisitor& v){ v.visit(this); }
-            CharLitNode(LOC_TY& loc, char c) : Node(loc), val(c){}
+            CharLitNode(LOC_TY const& loc, char c) : Node(loc), val(c){}
             ~CharLitNode(){}
         };
 
         struct ArrayNode : public Node{
             std::vector<std::unique_ptr<Node>> exprs;
             void accept(NodeVisitor& v){ v.visit(this); }
-            ArrayNode(LOC_TY& loc, std::vector<std::unique_ptr<Node>>& e) : Node(loc), exprs(move(e)){}
+            ArrayNode(LOC_TY const& loc, std::vector<std::unique_ptr<Node>>& e) : Node(loc), exprs(move(e)){}
             ~ArrayNode(){}
         };
 
@@ -165,7 +178,7 @@ namespace ante {
             void accept(NodeVisitor& v){ v.visit(this); }
 
             std::vector<TypedValue> unpack(Compiler*);
-            TupleNode(LOC_TY& loc, std::vector<std::unique_ptr<Node>>& e) : Node(loc), exprs(move(e)){}
+            TupleNode(LOC_TY const& loc, std::vector<std::unique_ptr<Node>>& e) : Node(loc), exprs(move(e)){}
             ~TupleNode(){}
         };
 
@@ -173,7 +186,7 @@ namespace ante {
             int op;
             std::unique_ptr<Node> rval;
             void accept(NodeVisitor& v){ v.visit(this); }
-            UnOpNode(LOC_TY& loc, int s, Node *rv) : Node(loc), op(s), rval(rv){}
+            UnOpNode(LOC_TY const& loc, int s, Node *rv) : Node(loc), op(s), rval(rv){}
             ~UnOpNode(){}
         };
 
@@ -183,21 +196,21 @@ namespace ante {
             Declaration* decl;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            BinOpNode(LOC_TY& loc, int s, Node *lv, Node *rv) : Node(loc), op(s), lval(lv), rval(rv), decl(0){}
+            BinOpNode(LOC_TY const& loc, int s, Node *lv, Node *rv) : Node(loc), op(s), lval(lv), rval(rv), decl(0){}
             ~BinOpNode(){}
         };
 
         struct SeqNode : public Node{
             std::vector<std::unique_ptr<Node>> sequence;
             void accept(NodeVisitor& v){ v.visit(this); }
-            SeqNode(LOC_TY& loc) : Node(loc), sequence(){}
+            SeqNode(LOC_TY const& loc) : Node(loc), sequence(){}
             ~SeqNode(){}
         };
 
         struct BlockNode : public Node{
             std::unique_ptr<Node> block;
             void accept(NodeVisitor& v){ v.visit(this); }
-            BlockNode(LOC_TY& loc, Node *b) : Node(loc), block(b){}
+            BlockNode(LOC_TY const& loc, Node *b) : Node(loc), block(b){}
             ~BlockNode(){}
         };
 
@@ -223,10 +236,10 @@ namespace ante {
             }
 
             /** Constructor for normal modifiers */
-            ModNode(LOC_TY& loc, int m, Node *e) : Node(loc), mod(m), expr(e){}
+            ModNode(LOC_TY const& loc, int m, Node *e) : Node(loc), mod(m), expr(e){}
 
             /** Constructor for compiler directives */
-            ModNode(LOC_TY& loc, Node *d, Node *e) : Node(loc), mod(CD_ID), directive(d), expr(e){}
+            ModNode(LOC_TY const& loc, Node *d, Node *e) : Node(loc), mod(CD_ID), directive(d), expr(e){}
             ~ModNode(){}
         };
 
@@ -238,7 +251,7 @@ namespace ante {
             bool isRowVar = false;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            TypeNode(LOC_TY& loc, TypeTag ty, std::string tName, TypeNode* eTy)
+            TypeNode(LOC_TY const& loc, TypeTag ty, std::string tName, TypeNode* eTy)
                 : ModifiableNode(loc), typeTag(ty), typeName(tName), extTy(eTy), params(){}
             ~TypeNode(){}
         };
@@ -247,7 +260,7 @@ namespace ante {
             std::unique_ptr<TypeNode> typeExpr;
             std::vector<std::unique_ptr<Node>> args;
             void accept(NodeVisitor& v){ v.visit(this); }
-            TypeCastNode(LOC_TY& loc, TypeNode *ty, std::vector<std::unique_ptr<Node>> &&a)
+            TypeCastNode(LOC_TY const& loc, TypeNode *ty, std::vector<std::unique_ptr<Node>> &&a)
                 : Node(loc), typeExpr(ty), args(std::move(a)){}
             ~TypeCastNode(){}
         };
@@ -255,7 +268,7 @@ namespace ante {
         struct RetNode : public Node{
             std::unique_ptr<Node> expr;
             void accept(NodeVisitor& v){ v.visit(this); }
-            RetNode(LOC_TY& loc, Node* e) : Node(loc), expr(e){}
+            RetNode(LOC_TY const& loc, Node* e) : Node(loc), expr(e){}
             ~RetNode(){}
         };
 
@@ -264,7 +277,7 @@ namespace ante {
             std::unique_ptr<Node> typeExpr;
             Declaration* decl = 0;
             void accept(NodeVisitor& v){ v.visit(this); }
-            NamedValNode(LOC_TY& loc, std::string s, Node* t) : Node(loc), name(s), typeExpr(t), decl(0){}
+            NamedValNode(LOC_TY const& loc, std::string s, Node* t) : Node(loc), name(s), typeExpr(t), decl(0){}
             ~NamedValNode(){}
 
             virtual AnType* getType() const {
@@ -282,7 +295,7 @@ namespace ante {
             std::string name;
             Declaration* decl;
             void accept(NodeVisitor& v){ v.visit(this); }
-            VarNode(LOC_TY& loc, std::string s) : Node(loc), name(s), decl(0){}
+            VarNode(LOC_TY const& loc, std::string s) : Node(loc), name(s), decl(0){}
             ~VarNode(){}
 
             AnType* getType() const;
@@ -292,7 +305,7 @@ namespace ante {
         struct StrLitNode : public Node{
             std::string val;
             void accept(NodeVisitor& v){ v.visit(this); }
-            StrLitNode(LOC_TY& loc, std::string s) : Node(loc), val(s){}
+            StrLitNode(LOC_TY const& loc, std::string s) : Node(loc), val(s){}
             ~StrLitNode(){}
         };
 
@@ -301,7 +314,7 @@ namespace ante {
             std::unique_ptr<Node> expr;
             bool freeLval;
             void accept(NodeVisitor& v){ v.visit(this); }
-            VarAssignNode(LOC_TY& loc, Node* v, Node* exp, bool b)
+            VarAssignNode(LOC_TY const& loc, Node* v, Node* exp, bool b)
                 : ModifiableNode(loc), ref_expr(v), expr(exp), freeLval(b){}
             ~VarAssignNode(){ if(freeLval) delete ref_expr; }
         };
@@ -315,7 +328,7 @@ namespace ante {
             TraitImpl *traitType;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            ExtNode(LOC_TY& loc, TypeNode *ty, Node *m, TypeNode *tr)
+            ExtNode(LOC_TY const& loc, TypeNode *ty, Node *m, TypeNode *tr)
                 : ModifiableNode(loc), typeExpr(ty), trait(tr), methods(m), traitType(0){}
             ~ExtNode(){}
         };
@@ -323,7 +336,7 @@ namespace ante {
         struct ImportNode : public Node{
             std::unique_ptr<Node> expr;
             void accept(NodeVisitor& v){ v.visit(this); }
-            ImportNode(LOC_TY& loc, Node* e) : Node(loc), expr(e){}
+            ImportNode(LOC_TY const& loc, Node* e) : Node(loc), expr(e){}
             ~ImportNode(){}
         };
 
@@ -331,14 +344,14 @@ namespace ante {
             std::unique_ptr<Node> expr;
             int jumpType;
             void accept(NodeVisitor& v){ v.visit(this); }
-            JumpNode(LOC_TY& loc, int jt, Node* e) : Node(loc), expr(e), jumpType(jt){}
+            JumpNode(LOC_TY const& loc, int jt, Node* e) : Node(loc), expr(e), jumpType(jt){}
             ~JumpNode(){}
         };
 
         struct WhileNode : public Node{
             std::unique_ptr<Node> condition, child;
             void accept(NodeVisitor& v){ v.visit(this); }
-            WhileNode(LOC_TY& loc, Node *cond, Node *body)
+            WhileNode(LOC_TY const& loc, Node *cond, Node *body)
                 : Node(loc), condition(cond), child(body){}
             ~WhileNode(){}
         };
@@ -348,7 +361,7 @@ namespace ante {
             TraitImpl *iterableInstance = 0;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            ForNode(LOC_TY& loc, Node *v, Node *r, Node *body) :
+            ForNode(LOC_TY const& loc, Node *v, Node *r, Node *body) :
                 Node(loc), pattern(v), range(r), child(body){}
             ~ForNode(){}
         };
@@ -356,7 +369,7 @@ namespace ante {
         struct MatchBranchNode : public Node{
             std::unique_ptr<Node> pattern, branch;
             void accept(NodeVisitor& v){ v.visit(this); }
-            MatchBranchNode(LOC_TY& loc, Node *p, Node *b) : Node(loc), pattern(p), branch(b){}
+            MatchBranchNode(LOC_TY const& loc, Node *p, Node *b) : Node(loc), pattern(p), branch(b){}
             ~MatchBranchNode(){}
         };
 
@@ -365,7 +378,7 @@ namespace ante {
             std::vector<std::unique_ptr<MatchBranchNode>> branches;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            MatchNode(LOC_TY& loc, Node *e, std::vector<std::unique_ptr<MatchBranchNode>> &b)
+            MatchNode(LOC_TY const& loc, Node *e, std::vector<std::unique_ptr<MatchBranchNode>> &b)
                 : Node(loc), expr(e), branches(move(b)){}
             ~MatchNode(){}
         };
@@ -373,7 +386,7 @@ namespace ante {
         struct IfNode : public Node{
             std::unique_ptr<Node> condition, thenN, elseN;
             void accept(NodeVisitor& v){ v.visit(this); }
-            IfNode(LOC_TY& loc, Node* c, Node* then, Node* els)
+            IfNode(LOC_TY const& loc, Node* c, Node* then, Node* els)
                 : Node(loc), condition(c), thenN(then), elseN(els){}
             ~IfNode(){}
         };
@@ -389,7 +402,7 @@ namespace ante {
 
             void accept(NodeVisitor& v){ v.visit(this); }
 
-            FuncDeclNode(LOC_TY& loc, std::string s, TypeNode *t, NamedValNode *p,
+            FuncDeclNode(LOC_TY const& loc, std::string s, TypeNode *t, NamedValNode *p,
                 TypeNode *tcc, Node* b, bool va=false)
                 : ModifiableNode(loc), name(s), child(b), returnType(t), params(p),
                   typeClassConstraints(tcc), varargs(va), decl(0){}
@@ -413,10 +426,10 @@ namespace ante {
             bool isUnion;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            DataDeclNode(LOC_TY& loc, std::string s, Node* b, size_t f, bool a, bool u)
+            DataDeclNode(LOC_TY const& loc, std::string s, Node* b, size_t f, bool a, bool u)
                 : ModifiableNode(loc), child(b), name(s), fields(f), isAlias(a), isUnion(u){}
 
-            DataDeclNode(LOC_TY& loc, std::string s, Node* b, size_t f,
+            DataDeclNode(LOC_TY const& loc, std::string s, Node* b, size_t f,
                     std::vector<std::unique_ptr<TypeNode>> &&g, bool a, bool u)
                 : ModifiableNode(loc), child(b), name(s), fields(f), generics(move(g)), isAlias(a), isUnion(u){}
             ~DataDeclNode(){}
@@ -429,7 +442,7 @@ namespace ante {
             std::vector<std::unique_ptr<TypeNode>> fundeps;
 
             void accept(NodeVisitor& v){ v.visit(this); }
-            TraitNode(LOC_TY& loc, std::string s,
+            TraitNode(LOC_TY const& loc, std::string s,
                     std::vector<std::unique_ptr<TypeNode>> &&g,
                     std::vector<std::unique_ptr<TypeNode>> &&f, Node* b)
                 : ModifiableNode(loc), child(b), name(s), generics(move(g)), fundeps(move(f)){}
@@ -3,12 +3,8 @@
 
 #include "parser.h"
 
-#ifndef LOC_TY
-#define LOC_TY yy::location
-#endif
-
-//defined in lexer.cpp
-extern char* lextxt;
+//defined in lexer.cpp, one per parsing thread
+extern thread_local char* lextxt;
 
 namespace ante {
     namespace parser {
@@ -21,7 +17,7 @@ namespace ante {
         Node* applyMods(Node *mods, Node *decls);
 
         void createRoot();
-        void createRoot(LOC_TY& loc);
+        void createRoot(LOC_TY const& loc);
 
         Node* append_main(Node *n);
         Node* append_fn(Node *n);
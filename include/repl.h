@@ -1,21 +1,33 @@
 #ifndef AN_REPL_H
 #define AN_REPL_H
 
+#include <llvm/ADT/StringMap.h>
 #include "compiler.h"
+#include "variable.h"
 
 namespace ante {
     /**
      * Merge the contents of rn into the current RootNode
-     * of the compiler and update declarations accordingly
+     * of the compiler and update declarations accordingly.
+     *
+     * @param bindings The top-level variables of the previous lines, which
+     *        remain visible to rn.  Those declared by rn are added to it.
      */
     TypedValue mergeAndCompile(Compiler *c, parser::RootNode *rn,
-            parser::ModNode *anteExpr);
+            parser::ModNode *anteExpr, llvm::StringMap<Variable*> &bindings);
+
+    /**
+     * Compile the top-level expressions of rn into a new function
+     * and run it in the Compiler's JIT session.  The values of its
+     * top-level variables are kept in globals for later lines.
+     */
+    void evalLine(Compiler *c, parser::RootNode *rn);
 
     /**
      * Starts the read-eval printline loop.
      *
-     * Expects the given Compiler to already contain a main
-     * function or another valid insert point.
+     * Each line is compiled into the given Compiler's module and
+     * run in memory by its JIT session.
      */
     void startRepl(Compiler *c);
 }
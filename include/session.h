@@ -0,0 +1,116 @@
+#ifndef AN_SESSION_H
+#define AN_SESSION_H
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stack>
+#include <string>
+#include <vector>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/Allocator.h>
+
+namespace ante {
+    class Lexer;
+    struct Module;
+    struct AnTypeContainer;
+
+    namespace parser {
+        struct Node;
+        struct RootNode;
+    }
+
+    namespace capi {
+        struct CtFunc;
+    }
+
+    /**
+     * Owns all of the frontend state of a single compilation that
+     * would otherwise be process-wide: the lexer, the parse tree and
+     * the arena its nodes live in, the module tree, the error count, command-line flags, interned
+     * types and the compiler API table.
+     *
+     * Each thread has exactly one current session.  Free functions
+     * such as errorCount() and Module::getRoot() refer to it.  A thread
+     * starts with its own default session, so independent compilations
+     * can run on separate threads without sharing any of this state.
+     * A Compiler remembers the session it was created in and makes it
+     * current again whenever it is used.
+     */
+    class CompilationSession {
+        public:
+            /**
+             * Every parse tree node is allocated here and freed along with
+             * the session.  Declared first so that it outlives any member
+             * which may still own nodes.
+             */
+            llvm::BumpPtrAllocator nodeArena;
+
+            /** The lexer used by the parser, set with setLexer */
+            Lexer *lexer;
+
+            /** The RootNode of the last file parsed */
+            parser::RootNode *parseTree;
+
+            /** Stack of relative roots of the blocks currently being parsed */
+            std::stack<parser::Node*> blockRoots;
+
+            /** Root of the virtual module tree returned by Module::getRoot */
+            std::unique_ptr<Module> rootModule;
+
+            /** Names of the files referred to by SourceLocs, indexed by their file id - 1 */
+            std::vector<const std::string*> files;
+            llvm::DenseMap<const std::string*, uint32_t> fileIds;
+
+            /** Number of errors (excluding warnings and notes) shown so far */
+            size_t errorCount;
+
+            /** Counter used to name fresh type variables */
+            size_t typeVarCount;
+
+            /** Incremented whenever a trait impl or import is added to any module
+             *  of this session, invalidating the trait impl index of each of them. */
+            size_t implsAdded;
+
+            bool showTimingInformation;
+            bool coloredOutput;
+
+            /** If set, a compilation with errors exits the process instead of returning */
+            bool exitOnError;
+
+            /** Where errors, warnings, and notes are printed.  Defaults to std::cout */
+            std::ostream *diagnostics;
+
+            /** Every interned type.  Created on first use by antype.cpp */
+            std::shared_ptr<AnTypeContainer> types;
+
+            /** Compiler API functions callable from ante blocks.  Filled by capi::init */
+            std::map<std::string, std::unique_ptr<capi::CtFunc>> compapi;
+
+            CompilationSession();
+            ~CompilationSession();
+
+            CompilationSession(CompilationSession const&) = delete;
+            CompilationSession& operator=(CompilationSession const&) = delete;
+
+            /** Return the session current on this thread */
+            static CompilationSession& current();
+
+            /**
+             * Makes a session current on this thread for the lifetime
+             * of the Scope, restoring the previous session afterward.
+             */
+            class Scope {
+                CompilationSession *previous;
+
+                public:
+                    Scope(CompilationSession &session);
+                    ~Scope();
+
+                    Scope(Scope const&) = delete;
+                    Scope& operator=(Scope const&) = delete;
+            };
+    };
+}
+
+#endif /* end of include guard: AN_SESSION_H */
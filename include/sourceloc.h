@@ -0,0 +1,42 @@
+#ifndef AN_SOURCELOC_H
+#define AN_SOURCELOC_H
+
+#include <cstdint>
+#include <string>
+#include "location.hh"
+
+#ifndef LOC_TY
+#  define LOC_TY ante::SourceLoc
+#endif
+
+namespace ante {
+
+    /**
+     * A source location compact enough to be stored in every parse tree node.
+     *
+     * Each position of a yy::location carries its own filename pointer.
+     * A SourceLoc instead stores one id into the file table of the
+     * current CompilationSession alongside 32-bit line and column numbers.
+     * It is only expanded back into a yy::location when an error is shown.
+     */
+    struct SourceLoc {
+        /** Index into CompilationSession::files plus one, or 0 if the file is unknown */
+        uint32_t file;
+        uint32_t beginLine, beginColumn;
+        uint32_t endLine, endColumn;
+
+        SourceLoc() : file{0}, beginLine{1}, beginColumn{1}, endLine{1}, endColumn{1}{}
+
+        /** Compact loc, adding its file to the current session's file table if needed */
+        SourceLoc(yy::location const& loc);
+
+        /** Return the name of the file this location is in, or nullptr if it is unknown.
+         *  The location must have been made in the current session. */
+        const std::string* fileName() const;
+
+        /** Expand this location back into the yy::location it was made from */
+        yy::location expand() const;
+    };
+}
+
+#endif /* end of include guard: AN_SOURCELOC_H */
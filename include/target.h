@@ -41,6 +41,7 @@
 
 #  define AN_NATIVE_OS "darwin"
 #  define AN_NATIVE_VENDOR "apple"
+#  define AN_LINKER_GC_FLAG "-Wl,-dead_strip"
 #  ifndef AN_LIB_DIR
 #    define AN_LIB_DIR "/usr/local/include/ante/"
 #  endif
@@ -139,6 +140,12 @@
 #  define AN_LINKER "gcc"
 #endif
 
+//Passed to AN_LINKER to remove unused sections.  Each function and global
+//is emitted into its own section so this strips any that are unreferenced.
+#ifndef AN_LINKER_GC_FLAG
+#  define AN_LINKER_GC_FLAG "-Wl,--gc-sections"
+#endif
+
 #ifndef AN_EXEC_STR
 #  define AN_EXEC_STR "./"
 #endif
@@ -24,11 +24,14 @@ namespace ante {
         bool isUnionType;
         bool isAlias;
 
+        /** True if this type was declared with ![counted_iterator], see CountedIterator in compiler.cpp */
+        bool isCountedIterator;
+
         AnType *aliasedType;
 
         mutable std::unordered_map<TypeArgs, llvm::Type*> variantTypes;
 
-        TypeDecl(AnType *type, LOC_TY &loc) : type{type}, loc{loc}, isUnionType{false}, isAlias{false}{}
+        TypeDecl(AnType *type, LOC_TY &loc) : type{type}, loc{loc}, isUnionType{false}, isAlias{false}, isCountedIterator{false}{}
 
         std::vector<std::string> fields;
 
@@ -6,7 +6,88 @@
 #include <tuple>
 
 namespace ante {
-    using Substitutions = std::list<std::pair<AnType*, AnType*>>;
+    /**
+     * The solution to a set of type equality constraints.
+     *
+     * Type variables are grouped into equivalence classes using a union-find
+     * forest with path compression and union by rank.  The root of each class
+     * stores the type the class is bound to, if any, along with the type
+     * variable that the class resolves to while it is still unbound.
+     * Type variables are compared by identity, not by name.
+     */
+    class Substitutions {
+        struct Node {
+            AnTypeVarType *parent;
+
+            /** The type variable this class resolves to while unbound.  Only valid on roots. */
+            AnTypeVarType *canonical;
+
+            /** The non-typevar type this class is bound to, or nullptr.  Only valid on roots. */
+            AnType *binding;
+
+            unsigned int rank;
+        };
+
+        /** Mutable so that lookups in a const Substitutions can still compress paths */
+        mutable std::unordered_map<const AnTypeVarType*, Node> forest;
+
+        /** Each type variable in the forest, in the order it was first bound */
+        std::vector<AnTypeVarType*> order;
+
+        /** Cache of fully resolved types for each root.  Cleared whenever a binding changes */
+        mutable std::unordered_map<const AnTypeVarType*, AnType*> resolved;
+
+        /** Cache of the (typevar, resolved type) pairs returned by begin() and end() */
+        mutable std::vector<std::pair<AnType*, AnType*>> bindingList;
+        mutable bool bindingListIsValid = true;
+
+        Node& getNode(AnTypeVarType *tv);
+
+        void invalidateCaches();
+
+        public:
+            using const_iterator = std::vector<std::pair<AnType*, AnType*>>::const_iterator;
+
+            Substitutions(){}
+
+            /** Construct from a list of (typevar, type) pairs, binding each in order */
+            Substitutions(std::initializer_list<std::pair<AnType*, AnType*>> bindings);
+
+            /** Return the representative of the class containing tv.
+             *  Returns tv itself if it has never been bound. */
+            AnTypeVarType* find(AnTypeVarType *tv) const;
+
+            /** Bind tv to t.  If t is a bare type variable the two classes are merged
+             *  and the merged class resolves to t's class.  Otherwise tv's class is
+             *  bound to t, overwriting any previous binding. */
+            void bind(AnTypeVarType *tv, AnType *t);
+
+            /** Follow bindings at the top level of t only, returning either an unbound
+             *  type variable or a type whose outermost constructor is known. */
+            AnType* shallowResolve(AnType *t) const;
+
+            /** Replace every bound type variable in t, recursively. */
+            AnType* resolve(AnType *t) const;
+
+            /** True if an unbound type variable remains in t after resolution */
+            bool containsUnboundTypeVar(AnType *t) const;
+
+            /** True if t contains a type variable in the same class as tv,
+             *  excluding the case where t is itself in that class. */
+            bool occurs(AnTypeVarType *tv, AnType *t) const;
+
+            /** True if no type variable resolves to anything besides itself */
+            bool empty() const noexcept {
+                return forest.empty();
+            }
+
+            /** The number of type variables that resolve to anything besides themselves */
+            size_t size() const;
+
+            /** Iterate over each (typevar, resolved type) pair */
+            const_iterator begin() const;
+            const_iterator end() const;
+    };
 
     class UnificationConstraint {
         using EqConstraint = std::pair<AnType*, AnType*>;
@@ -55,6 +136,12 @@ namespace ante {
 
     Substitutions unify(UnificationList const& list);
 
+    /**
+     * Unify without reporting any errors.  Returns whether unification
+     * succeeded along with the substitutions found.  On failure these
+     * are the bindings made up to the first mismatch.
+     * Does not throw, so it is cheap to call on each candidate trait impl.
+     */
     std::pair<bool, Substitutions> tryUnify(AnType *a, AnType *b);
     std::pair<bool, Substitutions> tryUnify(std::vector<AnType*> const& a, std::vector<AnType*> const& b);
 
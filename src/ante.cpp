@@ -1,11 +1,17 @@
 #define NOMINMAX
 
+#include <atomic>
 #include <chrono>
+#include <sstream>
+#include <thread>
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Support/raw_os_ostream.h>
+#include <llvm-c/Target.h>
 #include "compapi.h"
 #include "target.h"
 #include "module.h"
+#include "objcache.h"
+#include "session.h"
 #include "typeinference.h"
 #include "nameresolution.h"
 #include "util.h"
@@ -46,10 +52,17 @@ void printHelp(){
     puts("\t-O <number>\tSet optimization level. Arg of 0 = none, 3 = all");
     puts("\t-r\t\tcompile and run");
     puts("\t-help\t\tprint this message");
+    puts("\t-j <number>\tcompile input files, or the code of a single file, in parallel on up to <number> threads");
     puts("\t-lib\t\tcompile as library (include all functions in binary and compile to object file)");
+    puts("\t-flto=thin\temit bitcode and optimize across modules with ThinLTO when linking");
+    puts("\t-flto=full\temit bitcode and optimize all modules as one when linking");
     puts("\t-emit-llvm\tprint llvm-IR as output");
     puts("\t-check\t\tCheck program for errors without compiling");
     puts("\t-no-color\tprint uncolored output");
+    puts("\t-cache-dir <dir>\treuse the object files of unchanged modules and compile-time code from <dir>");
+    puts("\t-cache-size <number>\tlimit the cache directory to <number> megabytes");
+    puts("\t-purge-cache\tremove every entry from the cache directory before compiling");
+    puts("\t-ctfe-jit-threshold <number>\tinterpret calls to each compile-time function up to <number> times before JIT-compiling it");
 
     puts("\nNative target: " AN_TARGET_TRIPLE);
 
@@ -57,6 +70,74 @@ void printHelp(){
     llvm::TargetRegistry::printRegisteredTargetsForVersion(os);
 }
 
+/**
+ * @brief Compiles each input file on up to jobs threads.
+ *
+ * Each file is compiled in its own CompilationSession, and thus its own
+ * LLVMContext, module tree, and interned types.  Diagnostics are buffered
+ * per file and printed in the order the files were given.  As when the
+ * files are compiled sequentially, each file is linked into its own
+ * executable.  With -r these are run in the same order once every file
+ * is compiled.
+ *
+ * @return The number of files that failed to compile
+ */
+size_t compileInParallel(CompilerArgs *args, size_t jobs){
+    struct Job {
+        std::ostringstream diagnostics;
+        string outFile;
+        bool failed = false;
+    };
+
+    auto const& files = args->inputFiles;
+    vector<Job> results(files.size());
+    std::atomic<size_t> nextFile{0};
+    bool colored = coloredOutput();
+
+    auto worker = [&]{
+        for(size_t i = nextFile++; i < files.size(); i = nextFile++){
+            Job &job = results[i];
+            CompilationSession session;
+            session.coloredOutput = colored;
+            session.exitOnError = false;
+            session.diagnostics = &job.diagnostics;
+            CompilationSession::Scope scope{session};
+
+            Compiler ante{files[i].c_str()};
+            ante.processArgs(args, /*run*/false);
+            job.outFile = ante.outFile;
+            job.failed = errorCount() > 0;
+        }
+    };
+
+    vector<std::thread> threads;
+    for(size_t i = 1; i < std::min(jobs, files.size()); i++)
+        threads.emplace_back(worker);
+    worker();
+    for(auto &t : threads)
+        t.join();
+
+    size_t failures = 0;
+    for(auto &job : results){
+        cout << job.diagnostics.str();
+        if(job.failed) failures++;
+    }
+
+    if(failures){
+        cout << flush;
+        fputs("Compilation aborted.\n", stderr);
+        return failures;
+    }
+
+    if(args->hasArg(Args::CompileAndRun)){
+        for(auto &job : results){
+            int res = system((AN_EXEC_STR + job.outFile).c_str());
+            if(res) continue; //silence unused return result warning
+        }
+    }
+    return 0;
+}
+
 #ifndef NO_MAIN
 int main(int argc, const char **argv){
     auto start = high_resolution_clock::now();
@@ -69,24 +150,49 @@ int main(int argc, const char **argv){
 
     auto *args = parseArgs(argc, argv);
     if(args->hasArg(Args::Help)) printHelp();
-    if(args->hasArg(Args::NoColor)) colored_output = false;
+    if(args->hasArg(Args::NoColor)) CompilationSession::current().coloredOutput = false;
+    CompilationSession::current().showTimingInformation = args->hasArg(Args::Time);
+
+    if(args->hasArg(Args::PurgeCache)){
+        if(auto *dir = args->getArg(Args::CacheDir))
+            ObjectCache::purge(dir->arg);
+        else
+            cerr << "-purge-cache requires a cache directory given with -cache-dir\n";
+    }
 
-    for(auto input : args->inputFiles){
-        Compiler ante{input.c_str()};
-        if(args->hasArg(Args::Parse)){
-            showParseTree(ante.getAST(), ante.getModuleName());
+    size_t jobs = 1;
+    if(auto *arg = args->getArg(Args::Jobs))
+        jobs = std::max(atoi(arg->arg.c_str()), 1);
+
+    //The parse tree is printed directly to stdout so it is never done in parallel
+    if(jobs > 1 && args->inputFiles.size() > 1 && !args->hasArg(Args::Parse)){
+        if(compileInParallel(args, jobs))
+            return 1;
+    }else{
+        for(auto input : args->inputFiles){
+            //Each file needs its own session since compiled declarations
+            //cannot be shared between the LLVM modules of two Compilers
+            CompilationSession session;
+            session.coloredOutput = coloredOutput();
+            CompilationSession::Scope scope{session};
+
+            Compiler ante{input.c_str()};
+            if(args->hasArg(Args::Parse)){
+                showParseTree(ante.getAST(), ante.getModuleName());
+            }
+            ante.processArgs(args);
         }
-        ante.processArgs(args);
     }
     if(args->hasArg(Args::Eval) || (args->args.empty() && args->inputFiles.empty()))
         Compiler(0).eval();
-    if(yylexer)
-        delete yylexer;
+    setLexer(nullptr);
     //delete args;
 
     auto end = high_resolution_clock::now();
-    if(showTimingInformation())
+    if(showTimingInformation()){
+        ObjectCache::printStatistics();
         cout << "Total: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
+    }
     return 0;
 }
 #endif
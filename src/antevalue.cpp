@@ -2,6 +2,9 @@
 #include "types.h"
 #include "uniontag.h"
 #include "util.h"
+#include "jit.h"
+
+#include <cstring>
 
 using namespace std;
 using namespace llvm;
@@ -11,49 +14,123 @@ namespace ante {
         return f;
     }
 
-    TypedValue convertTupleToTypedValue(Compiler *c, AnteValue const& arg, AnTupleType *tn){
-        if(tn->fields.empty()){
-            return c->getUnitLiteral();
+    /**
+     * Values are laid out as they are by the JIT so they can be
+     * passed to and from JIT-compiled code without conversion.
+     */
+    DataLayout const& getLayout(Compiler *c){
+        return c->jit->getDataLayout();
+    }
+
+    size_t getMarshalledSize(Compiler *c, AnType *t){
+        if(t->typeTag == TT_Unit)
+            return 0;
+
+        return getLayout(c).getTypeAllocSize(c->anTypeToLlvmType(t));
+    }
+
+
+    /**
+     * Calls f(fieldType, offset) for each field of the tuple or data type t
+     * that is present in memory, with offsets in bytes from the JIT's data layout.
+     */
+    template<typename F>
+    void forEachField(Compiler *c, AnType *t, F f){
+        vector<AnType*> fields;
+        bool skipEmpty = false;
+        if(auto *dt = try_cast<AnDataType>(t)){
+            fields = dt->decl->isUnionType
+                ? dt->decl->getLargestVariantFieldTypes(c, dt)
+                : dt->getBoundFieldTypes();
+        }else{
+            //empty fields are left out of the llvm type of a tuple
+            fields = try_cast<AnTupleType>(t)->fields;
+            skipEmpty = true;
+        }
+
+        auto *structTy = cast<StructType>(c->anTypeToLlvmType(t));
+        auto *layout = getLayout(c).getStructLayout(structTy);
+
+        unsigned index = 0;
+        for(auto *field : fields){
+            if(skipEmpty && isEmptyType(c, field))
+                continue;
+
+            f(field, layout->getElementOffset(index++));
         }
+    }
 
-        auto elems = vecOf<Constant*>(tn->fields.size());
-        auto elemTys = vecOf<Type*>(tn->fields.size());
-        auto anElemTys = vecOf<AnType*>(tn->fields.size());
 
+    TypedValue convertTupleToTypedValue(Compiler *c, AnteValue const& arg, AnType *t){
+        auto *structTy = cast<StructType>(c->anTypeToLlvmType(t));
+        auto elems = vecOf<Constant*>(structTy->getNumElements());
         map<unsigned, Value*> nonConstants;
-        size_t offset = 0;
 
-        for(unsigned i = 0; i < tn->fields.size(); i++){
+        forEachField(c, t, [&](AnType *field, size_t offset){
             char* elem = (char*)arg.asRawData() + offset;
-            AnteValue elemTup{(void*)elem, tn->fields[i]};
-            TypedValue tval = elemTup.asTypedValue(c);
+            TypedValue tval = AnteValue{(void*)elem, field}.asTypedValue(c);
 
             if(auto elem = dyn_cast<Constant>(tval.val)){
                 elems.push_back(elem);
             }else{
-                nonConstants[i] = tval.val;
+                nonConstants[elems.size()] = tval.val;
                 elems.push_back(UndefValue::get(tval.getType()));
             }
+        });
 
-            auto res = tn->fields[i]->getSizeInBits(c);
-            if(!res){
-                error("Unknown/Unimplemented TypeTag " + typeTagToStr(tn->typeTag), unknownLoc());
-            }
-
-            offset += res.getVal() / 8;
-            elemTys.push_back(tval.getType());
-            anElemTys.push_back(tval.type);
+        if(elems.empty() && t->typeTag == TT_Tuple){
+            return c->getUnitLiteral();
         }
 
         //Create the constant tuple with undef values in place for the non-constant values
-        Value* tuple = ConstantStruct::get((StructType*)c->anTypeToLlvmType(tn), elems);
+        Value* tuple = ConstantStruct::get(structTy, elems);
 
         //Insert each pathogen value into the tuple individually
         for(const auto &p : nonConstants){
             tuple = c->builder.CreateInsertValue(tuple, p.second, p.first);
         }
 
-        return TypedValue(tuple, tn);
+        return TypedValue(tuple, t);
+    }
+
+
+    /**
+     * Converts an array back into a constant.  Arrays of integers and
+     * floats are built directly from their bytes by ConstantDataArray.
+     */
+    TypedValue convertArrayToTypedValue(Compiler *c, AnteValue const& arg, AnArrayType *arr){
+        auto &ctxt = *c->ctxt;
+        void *data = arg.asRawData();
+        size_t len = arr->len;
+
+        switch(arr->extTy->typeTag){
+            case TT_I8: case TT_U8: case TT_C8:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((uint8_t*)data, len)), arr};
+            case TT_I16: case TT_U16:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((uint16_t*)data, len)), arr};
+            case TT_I32: case TT_U32:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((uint32_t*)data, len)), arr};
+            case TT_I64: case TT_U64:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((uint64_t*)data, len)), arr};
+            case TT_F32:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((float*)data, len)), arr};
+            case TT_F64:
+                return {ConstantDataArray::get(ctxt, makeArrayRef((double*)data, len)), arr};
+            default: break;
+        }
+
+        size_t elemSize = getMarshalledSize(c, arr->extTy);
+        auto elems = vecOf<Constant*>(len);
+        for(size_t i = 0; i < len; i++){
+            char *elem = (char*)data + i * elemSize;
+            TypedValue tval = AnteValue{(void*)elem, arr->extTy}.asTypedValue(c);
+            if(!isa<Constant>(tval.val))
+                error("Cannot convert non-constant array element", unknownLoc());
+            elems.push_back(cast<Constant>(tval.val));
+        }
+
+        auto *arrTy = cast<ArrayType>(c->anTypeToLlvmType(arr));
+        return {ConstantArray::get(arrTy, elems), arr};
     }
 
 
@@ -109,7 +186,7 @@ namespace ante {
             case TT_F32:             return TypedValue(ConstantFP::get(*c->ctxt, APFloat(*(float*)data)), type);
             case TT_F64:             return TypedValue(ConstantFP::get(*c->ctxt, APFloat(*(double*)data)), type);
             case TT_Bool:            return TypedValue(c->builder.getInt1(*(uint8_t*)data), type);
-            case TT_Array:           break;
+            case TT_Array:           return convertArrayToTypedValue(c, *this, try_cast<AnArrayType>(type));
             case TT_Ptr: {
                 auto *cint = c->builder.getIntN(AN_USZ_SIZE, *(size_t*)data);
                 auto *ty = c->anTypeToLlvmType(type);
@@ -117,7 +194,7 @@ namespace ante {
             }
             case TT_Data:
             case TT_Tuple:
-                return convertTupleToTypedValue(c, *this, try_cast<AnTupleType>(type));
+                return convertTupleToTypedValue(c, *this, type);
             case TT_TypeVar:
             case TT_Function:
                 break;
@@ -130,11 +207,8 @@ namespace ante {
     }
 
     void AnteValue::allocAndStoreValue(Compiler *c, TypedValue const& tv){
-        auto size = tv.type->getSizeInBits(c);
-        if(!size){
-            error(size.getErr(), unknownLoc());
-        }
-        data = malloc(size.getVal() / 8);
+        //zeroed so that padding never differs between equal values
+        data = calloc(1, max(getMarshalledSize(c, tv.type), (size_t)1));
         storeValue(c, tv);
     }
 
@@ -146,6 +220,12 @@ namespace ante {
         auto *ptrty = try_cast<AnPtrType>(tv.type);
 
         if(ConstantExpr *ce = dyn_cast<ConstantExpr>(tv.val)){
+            //pointer to the start of a constant global, eg. a string literal
+            if(ce->getOpcode() == Instruction::GetElementPtr && isa<GlobalVariable>(ce->getOperand(0))
+                    && all_of(ce->op_begin() + 1, ce->op_end(), [](Use &u){ return cast<Constant>(u)->isNullValue(); })){
+                storePtr(c, {ce->getOperand(0), ptrty});
+                return;
+            }
             Instruction *in = ce->getAsInstruction();
             auto ptr = TypedValue(in, ptrty);
             storePtr(c, ptr);
@@ -207,27 +287,40 @@ namespace ante {
 
 
     void AnteValue::storeTuple(Compiler *c, TypedValue const& tup){
-        auto *sty = try_cast<AnTupleType>(tup.type);
-        if(ConstantStruct *ca = dyn_cast<ConstantStruct>(tup.val)){
+        auto *agg = dyn_cast<Constant>(tup.val);
+        if(!agg || isa<ConstantAggregateZero>(agg) || isa<UndefValue>(agg)){
+            if(!agg) error("Compile-time function argument must be constant", unknownLoc());
+            //already zeroed by allocAndStoreValue
+            return;
+        }
+
+        void *orig_data = this->data;
+        unsigned i = 0;
+        forEachField(c, tup.type, [&](AnType *ty, size_t offset){
+            data = (char*)orig_data + offset;
+            storeValue(c, {agg->getAggregateElement(i++), ty});
+        });
+        data = orig_data;
+    }
+
+
+    void AnteValue::storeArray(Compiler *c, TypedValue const& arr){
+        auto *arrTy = try_cast<AnArrayType>(arr.type);
+
+        if(auto *cds = dyn_cast<ConstantDataSequential>(arr.val)){
+            //arrays of integers and floats are stored with the same layout they have in memory
+            StringRef bytes = cds->getRawDataValues();
+            memcpy(data, bytes.data(), bytes.size());
+        }else if(auto *ca = dyn_cast<ConstantArray>(arr.val)){
+            size_t elemSize = getMarshalledSize(c, arrTy->extTy);
             void *orig_data = this->data;
             for(size_t i = 0; i < ca->getNumOperands(); i++){
-                Value *elem = ca->getAggregateElement(i);
-                AnType *ty = sty->fields[i];
-                auto field = TypedValue(elem, ty);
-                storeValue(c, field);
-
-                auto size = ty->getSizeInBits(c);
-                if(!size){
-                    error("storeTuple: " + size.getErr(), unknownLoc());
-                }
-                data = (char*)data + size.getVal() / 8;
+                data = (char*)orig_data + i * elemSize;
+                storeValue(c, {ca->getOperand(i), arrTy->extTy});
             }
             data = orig_data;
-        }else{
-            //single-value "tuple"
-            AnType *ty = sty->fields[0];
-            auto field = TypedValue(tup.val, ty);
-            storeValue(c, field);
+        }else if(!isa<ConstantAggregateZero>(arr.val) && !isa<UndefValue>(arr.val)){
+            error("Compile-time function argument must be constant", unknownLoc());
         }
     }
 
@@ -292,8 +385,8 @@ namespace ante {
                 storeFloat(c, tv);
                 return;
             case TT_Ptr:
-            case TT_Function:
-            case TT_Array: storePtr(c, tv); return;
+            case TT_Function: storePtr(c, tv); return;
+            case TT_Array: storeArray(c, tv); return;
             case TT_TypeVar: {
                 //TODO: re-add
                 //auto *tvt = try_cast<AnTypeVarType>(tv.type);
@@ -334,27 +427,26 @@ namespace ante {
                 printUnion(c, os);
                 return;
             }else if(dt->name == "Str"){
-                os << '"' << castTo<string>() << '"';
+                //Str is a (ptr c8) followed by its usz length
+                auto *chars = castTo<char*>();
+                auto len = *(size_t*)((char*)data + sizeof(char*));
+                os << '"' << string(chars, len) << '"';
                 return;
             }
         }
         os << '(';
-        auto *agg = try_cast<AnTupleType>(type);
-        if(!agg){
+        if(!dt && !try_cast<AnTupleType>(type)){
             cerr << "printTupleOrData called on non-aggregate type\n";
             throw CtError();
         }
 
-        char* dataptr = (char*)data;
-        for(auto &ty : agg->fields){
-            auto size = ty->getSizeInBits(c);
-            AnteValue(dataptr, ty).printCtVal(c, os);
-            if(&ty != &agg->fields.back()){
-                cout << ", ";
-            }
-            dataptr += size.getVal() / 8;
-        }
-        putchar(')');
+        bool first = true;
+        forEachField(c, type, [&](AnType *ty, size_t offset){
+            if(!first) os << ", ";
+            AnteValue((char*)data + offset, ty).printCtVal(c, os);
+            first = false;
+        });
+        os << ')';
     }
 
 
@@ -383,9 +475,17 @@ namespace ante {
                     AnteValue(*(void**)data, try_cast<AnPtrType>(type)->elemTy).printCtVal(c, os);
                 }
                 break;
-            case TT_Array:
-                os << " [...]";
+            case TT_Array: {
+                auto *arr = try_cast<AnArrayType>(type);
+                size_t elemSize = getMarshalledSize(c, arr->extTy);
+                os << '[';
+                for(size_t i = 0; i < arr->len; i++){
+                    if(i) os << ", ";
+                    AnteValue((char*)data + i * elemSize, arr->extTy).printCtVal(c, os);
+                }
+                os << ']';
                 break;
+            }
             case TT_Data:
             case TT_Tuple:
                 printTupleOrData(c, os);
@@ -416,32 +516,31 @@ namespace ante {
             AnteVisitor::validate(c, n.get());
         }
 
-        size_t size = 0;
-        for(auto &tv : tvals){
-            auto elemSize = tv.type->getSizeInBits(c);
-            if(!elemSize){
-                error("AnteValue: sizeerror: " + elemSize.getErr(), unknownLoc());
-            }
+        //The AnteCall driver reads the arguments as the fields of a struct,
+        //so each is stored at its aligned offset within that struct
+        vector<llvm::Type*> fieldTys;
+        for(auto &tv : tvals)
+            if(tv.type->typeTag != TT_Unit)
+                fieldTys.push_back(c->anTypeToLlvmType(tv.type));
 
-            elemSize = elemSize.getVal() / 8;
+        auto *layout = getLayout(c).getStructLayout(StructType::get(*c->ctxt, fieldTys));
 
-            //we're reallocating the data manually here for the tuple
-            //so storeValue must be used instead of allocAndStore
-            void *dataBegin = realloc(data, size + elemSize.getVal());
-            if(!dataBegin){
-                ASSERT_UNREACHABLE("Out of memory, cannot realloc");
-            }
-            data = (char*)dataBegin + size;
+        //the whole argument tuple is allocated as one zeroed block
+        void *dataBegin = calloc(1, max((size_t)layout->getSizeInBytes(), (size_t)1));
+        unsigned field = 0;
+        for(auto &tv : tvals){
+            if(tv.type->typeTag == TT_Unit)
+                continue;
+
+            data = (char*)dataBegin + layout->getElementOffset(field++);
 
             if(tv.type->hasModifier(Tok_Mut)){
                 storeValue(c, findLastStore(c, tv));
             }else{
                 storeValue(c, tv);
             }
-
-            data = dataBegin;
-            size += elemSize.getVal();
         }
+        data = dataBegin;
     }
 
     AnteValue::AnteValue(Compiler *c, TypedValue const& val, unique_ptr<parser::Node> const& expr){
@@ -459,4 +558,10 @@ namespace ante {
             allocAndStoreValue(c, val);
         }
     }
+
+    AnteValue::AnteValue(Compiler *c, TypedValue const& val)
+            : data(nullptr), type(val.type){
+
+        allocAndStoreValue(c, val);
+    }
 }
@@ -4,6 +4,7 @@
 #include "uniontag.h"
 #include "unification.h"
 #include "util.h"
+#include "session.h"
 
 using namespace std;
 using namespace ante::parser;
@@ -11,6 +12,41 @@ using namespace ante::parser;
 namespace ante {
     vector<AnType> AnType::typeContainer;
 
+    /**
+     * Interning tables for each non-primitive kind of type.
+     * Each key is built from the already-interned components of
+     * a type, so hashing and comparing keys never needs to walk
+     * more than one level deep.
+     */
+    struct AnTypeContainer {
+        unordered_map<pair<const AnType*, TokenType>, unique_ptr<BasicModifier>> basicModifiers;
+        unordered_map<pair<const AnType*, Node*>, unique_ptr<CompilerDirectiveModifier>> directiveModifiers;
+        unordered_map<AnType*, unique_ptr<AnPtrType>> ptrTypes;
+        unordered_map<pair<AnType*, size_t>, unique_ptr<AnArrayType>> arrayTypes;
+        unordered_map<pair<vector<AnType*>, vector<string>>, unique_ptr<AnTupleType>> tupleTypes;
+        unordered_map<pair<pair<AnType*, vector<AnType*>>, vector<TraitImpl*>>, unique_ptr<AnFunctionType>> functionTypes;
+        unordered_map<pair<pair<string, TypeDecl*>, vector<AnType*>>, unique_ptr<AnDataType>> dataTypes;
+    };
+
+    /** Return the interning tables of the current CompilationSession */
+    AnTypeContainer& getTypeArena(){
+        auto &types = CompilationSession::current().types;
+        if(!types)
+            types = make_shared<AnTypeContainer>();
+        return *types;
+    }
+
+    size_t hashAll(vector<AnType*> const& tys){
+        size_t ret = tys.size();
+        for(auto *t : tys)
+            ret = hashCombine(ret, t->hash);
+        return ret;
+    }
+
+    size_t hashAll(vector<string> const& strs){
+        return std::hash<vector<string>>()(strs);
+    }
+
     void AnType::dump() const{
         cout << anTypeToStr(this) << endl;
     }
@@ -174,29 +210,63 @@ namespace ante {
     }
 
     BasicModifier* BasicModifier::get(const AnType *modifiedType, TokenType mod){
-        return new BasicModifier(modifiedType, mod);
+        auto key = make_pair(modifiedType, mod);
+        auto &table = getTypeArena().basicModifiers;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new BasicModifier(modifiedType, mod);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
     CompilerDirectiveModifier* CompilerDirectiveModifier::get(const AnType *modifiedType, Node *directive){
-        return new CompilerDirectiveModifier(modifiedType, directive);
+        auto key = make_pair(modifiedType, directive);
+        auto &table = getTypeArena().directiveModifiers;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new CompilerDirectiveModifier(modifiedType, directive);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
     AnPtrType* AnPtrType::get(AnType* ext){
-        return new AnPtrType(ext);
+        auto &table = getTypeArena().ptrTypes;
+        if(auto *existing = search(table, ext))
+            return existing;
+
+        auto ret = new AnPtrType(ext);
+        addKVPair(table, ext, ret);
+        return ret;
     }
 
     AnArrayType* AnArrayType::get(AnType* t, size_t len){
-        return new AnArrayType(t, len);
+        auto key = make_pair(t, len);
+        auto &table = getTypeArena().arrayTypes;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new AnArrayType(t, len);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
     AnTupleType* AnTupleType::get(vector<AnType*> const& fields){
-        return new AnTupleType(fields, {});
+        return AnTupleType::getAnonRecord(fields, {});
     }
 
     AnTupleType* AnTupleType::getAnonRecord(vector<AnType*> const& fields,
             vector<string> const& fieldNames){
 
-        return new AnTupleType(fields, fieldNames);
+        auto key = make_pair(fields, fieldNames);
+        auto &table = getTypeArena().tupleTypes;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new AnTupleType(fields, fieldNames);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
     AnFunctionType* AnFunctionType::get(AnType* retty,
@@ -217,7 +287,15 @@ namespace ante {
             vector<TraitImpl*> const& tcConstrains){
 
         auto const& params = elems.empty() ? vector<AnType*>{AnType::getUnit()} : elems;
-        return new AnFunctionType(retTy, params, tcConstrains);
+
+        auto key = make_pair(make_pair(retTy, params), tcConstrains);
+        auto &table = getTypeArena().functionTypes;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new AnFunctionType(retTy, params, tcConstrains);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
 
@@ -226,7 +304,14 @@ namespace ante {
     }
 
     AnDataType* AnDataType::get(std::string const& name, TypeArgs const& args, TypeDecl *decl){
-        return new AnDataType(name, args, decl);
+        auto key = make_pair(make_pair(name, decl), args);
+        auto &table = getTypeArena().dataTypes;
+        if(auto *existing = search(table, key))
+            return existing;
+
+        auto ret = new AnDataType(name, args, decl);
+        addKVPair(table, key, ret);
+        return ret;
     }
 
 
@@ -372,20 +457,18 @@ namespace ante {
                 if(!tn->params.empty()){
                     Substitutions subs;
                     for(i = 0; i < tn->params.size() && i < basety->typeArgs.size(); i++){
-                        auto *b = static_cast<AnTypeVarType*>(toAnType(tn->params[i].get(), module));
-                        auto *basetyTypeArg = try_cast<AnTypeVarType>(basety->typeArgs[i]);
-                        subs.emplace_back(basetyTypeArg, b);
+                        auto *b = toAnType(tn->params[i].get(), module);
+                        if(auto *basetyTypeArg = try_cast<AnTypeVarType>(basety->typeArgs[i]))
+                            subs.bind(basetyTypeArg, b);
                     }
                     ret = applySubstitutions(subs, ret);
                 }
 
                 // Fill in unspecified typevars;  eg change List to List 't
                 for(; i < basety->typeArgs.size(); i++){
-                    Substitutions subs;
                     auto *b = nextTypeVar();
                     auto *basetyTypeArg = try_cast<AnTypeVarType>(basety->typeArgs[i]);
-                    subs.emplace_back(basetyTypeArg, b);
-                    ret = applySubstitutions(subs, ret);
+                    ret = applySubstitutions({{basetyTypeArg, b}}, ret);
                 }
                 break;
             }
@@ -477,8 +560,10 @@ namespace ante {
     }
 
     bool AnType::operator==(AnType const& other) const noexcept {
+        // Identical types are interned into the same object, and the cached
+        // hash rejects most unequal types without walking either of them.
         if(this == &other) return true;
-        if(typeTag != other.typeTag) return false;
+        if(typeTag != other.typeTag || hash != other.hash) return false;
 
         if(this->isModifierType()){
             if(other.isModifierType()){
@@ -6,18 +6,25 @@ using namespace ante;
 using namespace std;
 
 map<string, Args> argsMap = {
-    {"-check",     Args::Check},
-    {"-c",         Args::CompileToObj},
-    {"-r",         Args::CompileAndRun},
-    {"-emit-llvm", Args::EmitLLVM},
-    {"-e",         Args::Eval},
-    {"-help",      Args::Help},
-    {"-lib",       Args::Lib},
-    {"-no-color",  Args::NoColor},
-    {"-O",         Args::OptLvl},
-    {"-o",         Args::OutputName},
-    {"-p",         Args::Parse},
-    {"-time",      Args::Time}
+    {"-cache-dir",  Args::CacheDir},
+    {"-cache-size", Args::CacheSize},
+    {"-purge-cache", Args::PurgeCache},
+    {"-check",      Args::Check},
+    {"-c",          Args::CompileToObj},
+    {"-r",          Args::CompileAndRun},
+    {"-ctfe-jit-threshold", Args::CtfeJitThreshold},
+    {"-emit-llvm",  Args::EmitLLVM},
+    {"-e",          Args::Eval},
+    {"-flto=full",  Args::FullLTO},
+    {"-help",       Args::Help},
+    {"-j",          Args::Jobs},
+    {"-lib",        Args::Lib},
+    {"-no-color",   Args::NoColor},
+    {"-O",          Args::OptLvl},
+    {"-o",          Args::OutputName},
+    {"-p",          Args::Parse},
+    {"-flto=thin",  Args::ThinLTO},
+    {"-time",       Args::Time}
 };
 
 void CompilerArgs::addArg(Args &&a, string &&s){
@@ -49,10 +56,10 @@ bool CompilerArgs::empty() const{
 enum ArgTy { None, Str, Int };
 
 ArgTy requiresArg(Args a){
-    if(a == OutputName)
+    if(a == OutputName || a == CacheDir)
         return ArgTy::Str;
 
-    if(a == OptLvl)
+    if(a == OptLvl || a == Jobs || a == CacheSize || a == CtfeJitThreshold)
         return ArgTy::Int;
 
     return ArgTy::None;
@@ -1,6 +1,7 @@
 #include "types.h"
 #include "antevalue.h"
 #include "compapi.h"
+#include "session.h"
 
 using namespace std;
 using namespace llvm;
@@ -69,10 +70,9 @@ extern "C" {
 namespace ante {
     //compiler-api
     namespace capi {
-        map<string, unique_ptr<CtFunc>> compapi;
-
         void init(){
             using U = std::unique_ptr<CtFunc>;
+            auto &compapi = CompilationSession::current().compapi;
             compapi.emplace("debug",       U(new CtFunc((void*)Ante_debug,       AnType::getUnit(), {AnTypeVarType::get("'t'")})));
             compapi.emplace("sizeof",      U(new CtFunc((void*)Ante_sizeof,      AnType::getU32(),  {AnTypeVarType::get("'t'")})));
             compapi.emplace("typeof",      U(new CtFunc((void*)Ante_typeof,      AnPtrType::get(AnType::getUnit()), {AnTypeVarType::get("'t")})));
@@ -82,6 +82,10 @@ namespace ante {
         }
 
         CtFunc* lookup(string const& fn){
+            auto &compapi = CompilationSession::current().compapi;
+            if(compapi.empty())
+                init();
+
             auto it = compapi.find(fn);
             return it != compapi.end() ?
                 it->second.get() : nullptr;
@@ -3,25 +3,36 @@
 #include <llvm/Support/raw_ostream.h>  //for ostream when outputting bitcode
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/raw_os_ostream.h>
+#include <llvm/Support/Program.h>      //for executing the linker
 #include <llvm/Transforms/Scalar.h>    //for most passes
 #include <llvm/Transforms/IPO.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Target/TargetMachine.h>
+#include <llvm-c/TargetMachine.h>       //for LLVMTargetMachineEmitToFile
 #include <llvm/Linker/Linker.h>
-#include <llvm/ExecutionEngine/SectionMemoryManager.h>
-#include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/Transforms/IPO/AlwaysInliner.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/LTO/Caching.h>
+#include <llvm/ADT/StringSet.h>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <chrono>
+#include <thread>
 
 #include "parser.h"
 #include "compiler.h"
 #include "function.h"
+#include "interpreter.h"
 #include "types.h"
 #include "trait.h"
 #include "repl.h"
@@ -280,6 +291,9 @@ TypedValue callForLoopTraitFn(Compiler *c, string const& fnName, TypedValue cons
         c->compUnit->lookupTraitImpl("Iterable", {arg.type}):
         c->compUnit->lookupTraitImpl("Iterator", {arg.type});
 
+    if(!impl)
+        return {};
+
     TypedValue fn = compForLoopTraitFn(c, fnName, impl, arg.type, loc);
 
     array<Value*, 1> args{arg.val};
@@ -288,6 +302,153 @@ TypedValue callForLoopTraitFn(Compiler *c, string const& fnName, TypedValue cons
 }
 
 
+/** Bind the current element of a for loop's iterator to the loop's pattern */
+void bindForLoopPattern(Compiler *c, ForNode *n, TypedValue const& elem){
+    TypeError err{"A for-loop's binding pattern should match the return type of the iterator's unwrap function, but found " +
+            anTypeToColoredStr(n->pattern->getType()) + " and " + anTypeToColoredStr(elem.type) + " respectively", n->pattern->loc};
+
+    auto subs = unify({{n->pattern->getType(), elem.type, err}});
+    c->compCtxt->monomorphisationBindings.bind(subs);
+
+    auto vn = dynamic_cast<VarNode*>(n->pattern.get());
+    if(vn){
+        vn->decl->tval = elem;
+    }
+
+    //TODO: handle arbitrary patterns
+    // auto *decl = n->pattern->decls[0];
+    // decl->tval = elem;
+}
+
+
+/**
+ * @brief The layout of an iterator type marked with ![counted_iterator]
+ *
+ * A counted iterator is either a range of three integers (start, end, step)
+ * whose elements are each integer from start to end, or a view of an array
+ * (ref 't, idx, len) whose elements are each element of the array from idx
+ * up to len.
+ */
+struct CountedIterator {
+    bool isView;
+    AnType *elemType;
+    AnType *indexType;
+};
+
+
+/**
+ * Check if iterType is a counted iterator with one of the layouts
+ * described by CountedIterator and fill out ret if it is.
+ */
+bool getCountedIterator(Compiler *c, AnType *iterType, CountedIterator &ret){
+    auto *dt = try_cast<AnDataType>(c->compCtxt->monomorphisationBindings.apply(iterType));
+    if(!dt || dt->decl->isUnionType || !dt->decl->isCountedIterator)
+        return false;
+
+    auto fields = dt->getBoundFieldTypes();
+    if(fields.size() != 3 || fields[1] != fields[2] || !isIntegerTypeTag(fields[1]->typeTag))
+        return false;
+
+    ret.indexType = fields[1];
+
+    if(auto *view = try_cast<AnPtrType>(fields[0])){
+        ret.isView = true;
+        ret.elemType = view->elemTy;
+        return true;
+    }else if(fields[0] == fields[1]){
+        ret.isView = false;
+        ret.elemType = fields[0];
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Compile a for loop over a counted iterator as a loop over a single
+ * integer phi node rather than through the Iterator trait.  Each loop
+ * bound is extracted once beforehand so that LLVM can recognize the
+ * phi as an induction variable.
+ */
+void compileCountedLoop(CompilingVisitor &cv, ForNode *n, TypedValue &iter, CountedIterator const& it,
+        BasicBlock *cond, BasicBlock *begin, BasicBlock *incr, BasicBlock *end){
+
+    Compiler *c = cv.c;
+    bool isSigned = !isUnsignedTypeTag(it.indexType->typeTag);
+    auto lt = isSigned ? CmpInst::ICMP_SLT : CmpInst::ICMP_ULT;
+    auto gt = isSigned ? CmpInst::ICMP_SGT : CmpInst::ICMP_UGT;
+
+    Value *view = nullptr, *start, *bound, *step;
+    if(it.isView){
+        view  = c->builder.CreateExtractValue(iter.val, 0);
+        start = c->builder.CreateExtractValue(iter.val, 1);
+        bound = c->builder.CreateExtractValue(iter.val, 2);
+        step  = ConstantInt::get(start->getType(), 1);
+    }else{
+        start = c->builder.CreateExtractValue(iter.val, 0);
+        bound = c->builder.CreateExtractValue(iter.val, 1);
+        step  = c->builder.CreateExtractValue(iter.val, 2);
+    }
+
+    BasicBlock *preheader = c->builder.GetInsertBlock();
+    c->builder.CreateBr(cond);
+    c->builder.SetInsertPoint(cond);
+
+    PHINode *idx = c->builder.CreatePHI(start->getType(), 2, "idx");
+    idx->addIncoming(start, preheader);
+
+    Value *hasNext;
+    if(it.isView){
+        hasNext = c->builder.CreateICmp(lt, idx, bound);
+    }else{
+        //(step > 0 and idx < end) or (step < 0 and idx > end)
+        auto *zero = ConstantInt::get(step->getType(), 0);
+        Value *up = c->builder.CreateAnd(c->builder.CreateICmp(gt, step, zero), c->builder.CreateICmp(lt, idx, bound));
+        Value *down = c->builder.CreateAnd(c->builder.CreateICmp(lt, step, zero), c->builder.CreateICmp(gt, idx, bound));
+        hasNext = c->builder.CreateOr(up, down);
+    }
+    c->builder.CreateCondBr(hasNext, begin, end);
+    c->builder.SetInsertPoint(begin);
+
+    TypedValue elem{idx, it.elemType};
+    if(it.isView){
+        Value *elemPtr = c->builder.CreateInBoundsGEP(view, idx);
+        elem.val = c->builder.CreateLoad(elemPtr);
+    }
+
+    bindForLoopPattern(c, n, elem);
+
+    c->compCtxt->breakLabels->push_back(end);
+    c->compCtxt->continueLabels->push_back(incr);
+
+    try{
+        n->child->accept(cv);
+    }catch(CtError const& e){
+        c->compCtxt->breakLabels->pop_back();
+        c->compCtxt->continueLabels->pop_back();
+        throw e;
+    }
+
+    c->compCtxt->breakLabels->pop_back();
+    c->compCtxt->continueLabels->pop_back();
+
+    if(!c->builder.GetInsertBlock()->getTerminator())
+        c->builder.CreateBr(incr);
+
+    //idx < len for views so the increment cannot overflow
+    c->builder.SetInsertPoint(incr);
+    Value *next = !it.isView ? c->builder.CreateAdd(idx, step)
+        : isSigned ? c->builder.CreateNSWAdd(idx, step)
+        : c->builder.CreateNUWAdd(idx, step);
+
+    idx->addIncoming(next, incr);
+    c->builder.CreateBr(cond);
+
+    c->builder.SetInsertPoint(end);
+    cv.val = c->getUnitLiteral();
+}
+
+
 void CompilingVisitor::visit(ForNode *n){
     Function *f = c->builder.GetInsertBlock()->getParent();
     BasicBlock *cond  = BasicBlock::Create(*c->ctxt, "for_cond", f);
@@ -299,16 +460,26 @@ void CompilingVisitor::visit(ForNode *n){
 
     //check if the range expression is its own iterator and thus implements Iterator
     //If it does not, see if it implements Iterable by attempting to call into_iter on it
-    rangev = callForLoopTraitFn(c, "into_iter", rangev, n->range->loc);
-    if(!rangev)
+    if(TypedValue iter = callForLoopTraitFn(c, "into_iter", rangev, n->range->loc)){
+        rangev = iter;
+    }else if(!c->compUnit->lookupTraitImpl("Iterator", {rangev.type})){
         error("Range expression of type " + anTypeToColoredStr(rangev.type) + " needs to implement " +
             lazy_str("Iterable", AN_TYPE_COLOR) + " and " + lazy_str("Iterator", AN_TYPE_COLOR) +
             " to be used in a for loop", n->range->loc);
+    }
+
+    CountedIterator counted;
+    if(getCountedIterator(c, rangev.type, counted)){
+        compileCountedLoop(*this, n, rangev, counted, cond, begin, incr, end);
+        return;
+    }
 
     //by this point, rangev now properly stores the range information,
     //so store it on the stack and insert calls to unwrap, has_next,
     //and next at the beginning, beginning, and end of the loop respectively.
-    Value *alloca = c->builder.CreateAlloca(rangev.getType());
+    auto &slots = *c->compCtxt->stackSlots;
+    slots.pushScope();
+    Value *alloca = slots.createScoped(c->builder, rangev.getType());
     c->builder.CreateStore(rangev.val, alloca);
 
     c->builder.CreateBr(cond);
@@ -332,20 +503,7 @@ void CompilingVisitor::visit(ForNode *n){
     if(!uwrap) error("Range expression of type " + anTypeToColoredStr(rangev.type) + " does not implement " +
             lazy_str("Iterable", AN_TYPE_COLOR) + ", which it needs to be used in a for loop", n->range->loc);
 
-    TypeError err{"A for-loop's binding pattern should match the return type of the iterator's unwrap function, but found " +
-            anTypeToColoredStr(n->pattern->getType()) + " and " + anTypeToColoredStr(uwrap.type) + " respectively", n->pattern->loc};
-
-    auto subs = unify({{n->pattern->getType(), uwrap.type, err}});
-    c->compCtxt->insertMonomorphisationMappings(subs);
-
-    auto vn = dynamic_cast<VarNode*>(n->pattern.get());
-    if(vn){
-        vn->decl->tval = uwrap;
-    }
-
-    //TODO: handle arbitrary patterns
-    // auto *decl = n->pattern->decls[0];
-    // decl->tval = uwrap;
+    bindForLoopPattern(c, n, uwrap);
 
     //register the branches to break/continue to right before the body
     //is compiled in case there was an error compiling the range
@@ -358,13 +516,17 @@ void CompilingVisitor::visit(ForNode *n){
     }catch(CtError const& e){
         c->compCtxt->breakLabels->pop_back();
         c->compCtxt->continueLabels->pop_back();
+        slots.popScope(c->builder);
         throw e;
     }
 
     c->compCtxt->breakLabels->pop_back();
     c->compCtxt->continueLabels->pop_back();
 
-    if(!val) return;
+    if(!val){
+        slots.popScope(c->builder);
+        return;
+    }
     if(!dyn_cast<ReturnInst>(val.val) && !dyn_cast<BranchInst>(val.val)){
         //set range = next range
         c->builder.CreateBr(incr);
@@ -380,6 +542,7 @@ void CompilingVisitor::visit(ForNode *n){
     }
 
     c->builder.SetInsertPoint(end);
+    slots.popScope(c->builder);
     this->val = c->getUnitLiteral();
 }
 
@@ -422,9 +585,100 @@ void CompilingVisitor::visit(JumpNode *n){
 }
 
 
+AllocaInst* StackSlots::create(IRBuilder<> &builder, Type *type, Twine const& name){
+    BasicBlock &entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+
+    //keep every alloca together at the start of the entry block
+    auto it = entry.begin();
+    while(it != entry.end() && isa<AllocaInst>(*it))
+        ++it;
+
+    IRBuilder<> entryBuilder{&entry, it};
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+
+AllocaInst* StackSlots::createScoped(IRBuilder<> &builder, Type *type, Twine const& name){
+    if(scopes.empty())
+        return create(builder, type, name);
+
+    AllocaInst *slot;
+    auto &free = freeSlots[type];
+    if(!free.empty()){
+        slot = free.back();
+        free.pop_back();
+    }else{
+        slot = create(builder, type, name);
+    }
+
+    builder.CreateLifetimeStart(slot);
+    scopes.back().push_back(slot);
+    return slot;
+}
+
+
+void StackSlots::escape(AllocaInst *slot){
+    for(auto &scope : scopes){
+        auto it = std::find(scope.begin(), scope.end(), slot);
+        if(it != scope.end()){
+            scope.erase(it);
+            return;
+        }
+    }
+}
+
+
+void StackSlots::pushScope(){
+    scopes.emplace_back();
+}
+
+
+AllocaInst* getLoadedSlot(Value *v){
+    if(auto *evi = dyn_cast_or_null<ExtractValueInst>(v))
+        v = evi->getAggregateOperand();
+
+    auto *li = dyn_cast_or_null<LoadInst>(v);
+    if(!li)
+        return nullptr;
+
+    return dyn_cast<AllocaInst>(li->getPointerOperand()->stripInBoundsOffsets());
+}
+
+
+void StackSlots::popScope(IRBuilder<> &builder, Value *result){
+    auto *bb = builder.GetInsertBlock();
+    auto *resultSlot = getLoadedSlot(result);
+
+    for(auto *slot : scopes.back()){
+        if(slot == resultSlot)
+            continue;
+
+        //the end of a scope is unreachable if it already returned or jumped elsewhere
+        if(bb && !bb->getTerminator() && bb->getParent() == slot->getFunction())
+            builder.CreateLifetimeEnd(slot);
+
+        freeSlots[slot->getAllocatedType()].push_back(slot);
+    }
+    scopes.pop_back();
+
+    //Slots are only reused within the outermost scope they were created in,
+    //so no slot outlives the function it was allocated in
+    if(scopes.empty())
+        freeSlots.clear();
+}
+
+
 //create a new scope if the user indents
 void CompilingVisitor::visit(BlockNode *n){
-    n->block->accept(*this);
+    auto &slots = *c->compCtxt->stackSlots;
+    slots.pushScope();
+    try{
+        n->block->accept(*this);
+    }catch(CtError const& e){
+        slots.popScope(c->builder);
+        throw e;
+    }
+    slots.popScope(c->builder, val.val);
 }
 
 
@@ -446,7 +700,14 @@ void CompilingVisitor::visit(VarNode *n){
         n->decl->definition->accept(*this);
     }
     val = n->decl->tval;
-    if(n->decl->tval.type->hasModifier(Tok_Mut) && val.val->getType()->isPointerTy()){
+    bool isMutable = n->decl->tval.type->hasModifier(Tok_Mut) && val.val->getType()->isPointerTy();
+
+    //Variables whose value is kept in a global, such as tables computed during
+    //compile-time or variables of previous REPL lines, are loaded at each use
+    auto *global = dyn_cast<GlobalVariable>(val.val);
+    bool isStoredInGlobal = global && global->getValueType() == c->anTypeToLlvmType(val.type);
+
+    if(isMutable || isStoredInGlobal){
         val.val = c->builder.CreateLoad(val.val, n->name);
     }
 }
@@ -484,7 +745,7 @@ void compMutBinding(VarAssignNode *node, CompilingVisitor &cv){
     Value *ptr = decl->isGlobal() ?
             (Value*) new GlobalVariable(*c->module, val.getType(), false,
                     GlobalValue::PrivateLinkage, UndefValue::get(val.getType()), decl->name) :
-            c->builder.CreateAlloca(val.getType(), nullptr, decl->name.c_str());
+            c->compCtxt->stackSlots->createScoped(c->builder, val.getType(), decl->name);
 
     TypedValue alloca{ptr, val.type};
     decl->tval = alloca;
@@ -501,7 +762,21 @@ void compLetBinding(VarAssignNode *node, CompilingVisitor &cv){
 
     auto *decl = static_cast<VarNode*>(node->ref_expr)->decl;
 
-    TypedValue val = CompilingVisitor::compile(c, node->expr);
+    TypedValue val;
+    if(!c->isJIT && node->hasModifier(Tok_Ante))
+        val = InterpretingVisitor::tryInterpret(c, node->expr.get());
+
+    //interpreted values are constants and need no storage, even when global
+    bool needsStorage = !val;
+    if(!val)
+        val = CompilingVisitor::compile(c, node->expr);
+
+    //Aggregates from compile-time evaluation are kept in constant globals.  The
+    //variable refers to the global itself and each use loads from it so that
+    //it can be read from any function.
+    auto ctGlobal = getCtConstantGlobal(c, val);
+    if(isCtConstantGlobal(c, ctGlobal.val))
+        needsStorage = false;
 
     for(auto &n : node->modifiers){
         TokenType m = (TokenType)n->mod;
@@ -511,7 +786,7 @@ void compLetBinding(VarAssignNode *node, CompilingVisitor &cv){
     if(cv.c->isJIT)
         val.type = (AnType*)val.type->addModifier(Tok_Ante);
 
-    if(decl->isGlobal()){
+    if(decl->isGlobal() && needsStorage){
         //location to store var
         Value *ptr = new GlobalVariable(*c->module, val.getType(), false,
                         GlobalValue::PrivateLinkage, UndefValue::get(val.getType()), decl->name);
@@ -520,13 +795,20 @@ void compLetBinding(VarAssignNode *node, CompilingVisitor &cv){
         decl->tval = alloca;
         cv.val = {c->builder.CreateStore(val.val, alloca.val), val.type};
     }else{
-        decl->tval = val;
+        decl->tval = isCtConstantGlobal(c, ctGlobal.val) ? TypedValue(ctGlobal.val, val.type) : val;
         cv.val = val;
     }
 }
 
 
 void CompilingVisitor::visit(ModNode *n){
+    if(n->mod == Tok_Ante && n->expr && !c->isJIT){
+        if(auto ctval = InterpretingVisitor::tryInterpret(c, n->expr.get())){
+            val = loadCtConstant(c, ctval);
+            return;
+        }
+    }
+
     cerr << "Warning: " << Lexer::getTokStr(n->mod) << " unimplemented in expr:\n";
     PrintingVisitor::print(n);
     n->expr->accept(*this);
@@ -824,6 +1106,7 @@ bool Compiler::scanAllDecls(RootNode *root){
 }
 
 void Compiler::eval(){
+    CompilationSession::Scope scope{*session};
     //setup compiler
     // createMainFn();
     startRepl(this);
@@ -905,12 +1188,58 @@ void addPasses(llvm::Module *m, char optLvl){
 
 
 
+TargetMachine* getTargetMachine();
+
+/**
+ * @brief Runs the pre-link pipeline of the new PassManager over a module
+ * compiled with -flto.  Cross-module inlining and internalization are
+ * left for linkLto once every module is available.
+ */
+void addPreLinkPasses(llvm::Module *m, unsigned int optLvl, LtoMode mode){
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    //The LTO link creates its TargetMachines from the triple of each module
+    auto *tm = getTargetMachine();
+    m->setTargetTriple(tm->getTargetTriple().str());
+    m->setDataLayout(tm->createDataLayout());
+
+    if(optLvl > 0){
+        llvm::verifyModule(*m, &dbgs());
+
+        PassBuilder pb{tm};
+        LoopAnalysisManager lam;
+        FunctionAnalysisManager fam;
+        CGSCCAnalysisManager cgam;
+        ModuleAnalysisManager mam;
+        pb.registerModuleAnalyses(mam);
+        pb.registerCGSCCAnalyses(cgam);
+        pb.registerFunctionAnalyses(fam);
+        pb.registerLoopAnalyses(lam);
+        pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+        auto level = optLvl == 1 ? PassBuilder::O1
+                   : optLvl == 2 ? PassBuilder::O2
+                   : PassBuilder::O3;
+
+        ModulePassManager mpm = mode == LtoMode::Thin
+            ? pb.buildThinLTOPreLinkDefaultPipeline(level)
+            : pb.buildLTOPreLinkDefaultPipeline(level);
+        mpm.run(*m, mam);
+    }
+    auto end = high_resolution_clock::now();
+    if(showTimingInformation())
+        cout << "Llvm Optimizations: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
+}
+
+
 void Compiler::compile(){
     if(compiled){
         cerr << "Module " << module->getName().str() << " is already compiled, cannot recompile.\n";
         return;
     }
 
+    CompilationSession::Scope scope{*session};
     using namespace std::chrono;
     auto start = high_resolution_clock::now();
 
@@ -925,10 +1254,30 @@ void Compiler::compile(){
 
 
         auto end = high_resolution_clock::now();
-        if(showTimingInformation())
+        if(showTimingInformation()){
             std::cout << "Compiling: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
+            if(compCtxt->instancesCompiled){
+                std::cout << "    Instances compiled: " << compCtxt->instancesCompiled << '\n';
+                std::cout << "    Instances reused:   " << compCtxt->instancesReused << '\n';
+            }
+            auto &ctfeCache = ctCtxt->ctfeCache;
+            if(ctfeCache.hits || ctfeCache.misses){
+                std::cout << "    CTFE results reused:   " << ctfeCache.hits << '\n';
+                std::cout << "    CTFE results computed: " << ctfeCache.misses << '\n';
+            }
+            if(ctCtxt->callsInterpreted || ctCtxt->callsJitted){
+                std::cout << "    CTFE calls interpreted: " << ctCtxt->callsInterpreted << '\n';
+                std::cout << "    CTFE calls JIT-compiled: " << ctCtxt->callsJitted << '\n';
+            }
+            if(jit->modulesAdded)
+                jit->printStatistics();
+        }
 
-        if(!errorCount() && !isLib){
+        //With LTO, library modules are optimized too since they are
+        //internalized along with the rest of the program when linked
+        if(!errorCount() && ltoMode != LtoMode::None){
+            addPreLinkPasses(module.get(), optLvl, ltoMode);
+        }else if(!errorCount() && !isLib){
             addPasses(module.get(), optLvl);
         }
 
@@ -941,31 +1290,97 @@ void Compiler::compile(){
     }
 
     if(errorCount()){
-        fputs("Compilation aborted.\n", stderr);
-        exit(1);
+        compiled = true;
+        if(session->exitOnError){
+            fputs("Compilation aborted.\n", stderr);
+            exit(1);
+        }
     }
 }
 
 
+string Compiler::getCacheKey() const {
+    if(!objectCache || compiled)
+        return "";
+
+    string options = "-O " + to_string(optLvl);
+    if(isLib) options += " -lib";
+    if(ltoMode == LtoMode::Thin) options += " -flto=thin";
+    if(ltoMode == LtoMode::Full) options += " -flto=full";
+
+    return objectCache->getKey(fileName, options);
+}
+
 void Compiler::compileNative(){
+    CompilationSession::Scope scope{*session};
+
+    auto link = [&](vector<string> const& objFiles){
+        if(ltoMode != LtoMode::None)
+            linkLto(objFiles, outFile, optLvl, codegenThreads);
+        else
+            linkObj(objFiles, outFile);
+    };
+
+    string key = getCacheKey();
+    if(!key.empty()){
+        auto cached = objectCache->lookup(key);
+        if(!cached.empty()){
+            link(cached);
+            return;
+        }
+    }
+
     if(!compiled) compile();
+    if(errorCount()) return;
+
+    vector<string> objFiles;
+    if(ltoMode != LtoMode::None){
+        string bcFile = outFile + ".bc";
+        if(!compileIRtoBitcode(module.get(), bcFile))
+            objFiles.push_back(bcFile);
+    }else if(codegenThreads > 1){
+        objFiles = compileIRtoObjs(module.get(), outFile, codegenThreads);
+    }else{
+        //this file will become the obj file before linking
+        string objFile = outFile + ".o";
+        if(!compileIRtoObj(module.get(), objFile))
+            objFiles.push_back(objFile);
+    }
+
+    if(objFiles.empty())
+        return;
 
-    //this file will become the obj file before linking
-    string objFile = outFile + ".o";
+    if(!key.empty())
+        objectCache->store(key, objFiles, session->files);
 
-    if(!compileIRtoObj(module.get(), objFile)){
-        linkObj(objFile, outFile);
+    link(objFiles);
+    for(auto &objFile : objFiles)
         remove(objFile.c_str());
-    }
 }
 
 int Compiler::compileObj(string &outName){
-    if(!compiled) compile();
+    CompilationSession::Scope scope{*session};
 
     string modName = getModuleName();
     string objFile = outName.length() > 0 ? outName : modName + ".o";
 
-    return compileIRtoObj(module.get(), objFile);
+    string key = getCacheKey();
+    if(!key.empty()){
+        auto cached = objectCache->lookup(key);
+        if(cached.size() == 1)
+            return sys::fs::copy_file(cached[0], objFile) ? 1 : 0;
+    }
+
+    if(!compiled) compile();
+    if(errorCount()) return 1;
+
+    int res = ltoMode != LtoMode::None
+        ? compileIRtoBitcode(module.get(), objFile)
+        : compileIRtoObj(module.get(), objFile);
+
+    if(res == 0 && !key.empty())
+        objectCache->store(key, {objFile}, session->files);
+    return res;
 }
 
 
@@ -989,13 +1404,30 @@ const Target* getTarget(){
     return target;
 }
 
+/** Return the TargetOptions used when emitting native code */
+TargetOptions getTargetOptions(){
+    TargetOptions op;
+    op.FunctionSections = true;
+    op.DataSections = true;
+    return op;
+}
+
+/**
+ * Return the TargetMachine for the native target.  Creating one is
+ * expensive and it cannot be shared between threads, so each thread
+ * creates its own on first use and reuses it for every later module.
+ */
 TargetMachine* getTargetMachine(){
+    thread_local std::unique_ptr<TargetMachine> cached;
+    if(cached)
+        return cached.get();
+
     auto *target = getTarget();
 
     string cpu = "";
     string features = "";
     string triple = Triple(AN_NATIVE_ARCH, AN_NATIVE_VENDOR, AN_NATIVE_OS).getTriple();
-    TargetOptions op;
+    TargetOptions op = getTargetOptions();
 
     TargetMachine *tm = target->createTargetMachine(triple, cpu, features, op, Reloc::Model::PIC_,
             None, CodeGenOpt::Level::Aggressive);
@@ -1005,47 +1437,39 @@ TargetMachine* getTargetMachine(){
         exit(1);
     }
 
+    cached.reset(tm);
     return tm;
 }
 
 
 void Compiler::jitFunction(Function *f){
-    if(!jit.get()){
-        auto* eBuilder = new EngineBuilder(unique_ptr<llvm::Module>(module.get()));
-
-        string err;
-
-        jit.reset(eBuilder->setErrorStr(&err).setEngineKind(EngineKind::JIT).create());
-        if(err.length() > 0) cerr << err << endl;
-    }
-
-    compileIRtoObj(module.get(), (".tmp_" + f->getName()).str());
-    jit->addModule(move(module));
-    jit->finalizeObject();
-    remove((".tmp_" + f->getName()).str().c_str());
-
-    auto* fn = jit->getPointerToFunction(f);
+    auto *fn = jit->addModuleAndLookup(*module, f);
 
     if(fn)
         reinterpret_cast<void(*)()>(fn)();
 }
 
 
-int Compiler::compileIRtoObj(llvm::Module *mod, string outFile){
-    using namespace std::chrono;
-    auto start = high_resolution_clock::now();
-
+/** Emit mod to an obj file using this thread's TargetMachine.  Returns 0 on success */
+int emitObjFile(llvm::Module *mod, string const& outFile){
     auto *tm = getTargetMachine();
 
     char **err = nullptr;
     char *filename = (char*)outFile.c_str();
-    int res = LLVMTargetMachineEmitToFile(
+    return LLVMTargetMachineEmitToFile(
         (LLVMTargetMachineRef)tm,
         (LLVMModuleRef)mod,
         filename,
         (LLVMCodeGenFileType)llvm::TargetMachine::CGFT_ObjectFile, err);
+}
+
+
+int Compiler::compileIRtoObj(llvm::Module *mod, string outFile){
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    int res = emitObjFile(mod, outFile);
 
-    delete tm;
     auto end = high_resolution_clock::now();
     if(showTimingInformation())
         std::cout << "Writing .ll: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
@@ -1053,12 +1477,218 @@ int Compiler::compileIRtoObj(llvm::Module *mod, string outFile){
 }
 
 
-int Compiler::linkObj(string inFiles, string outFile){
+vector<string> Compiler::compileIRtoObjs(llvm::Module *mod, string const& outFile, unsigned partitions){
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    //Ensure the target is initialized before any worker looks it up
+    getTarget();
+
+    //The LLVMContext of mod cannot be used from several threads at once, so each
+    //partition is serialized to bitcode here and parsed into a fresh context by
+    //the thread which emits it.  Locals are externalized so that the partitions
+    //can still refer to each other once linked.
+    vector<SmallVector<char, 0>> bitcode;
+    SplitModule(CloneModule(*mod), partitions, [&](std::unique_ptr<llvm::Module> part){
+        bitcode.emplace_back();
+        raw_svector_ostream os{bitcode.back()};
+        WriteBitcodeToFile(*part, os);
+    });
+
+    vector<string> objFiles;
+    for(size_t i = 0; i < bitcode.size(); i++)
+        objFiles.push_back(outFile + "." + to_string(i) + ".o");
+
+    vector<int> results(bitcode.size(), 0);
+    auto emitPartition = [&](size_t i){
+        LLVMContext ctxt;
+        auto bitcodeRef = MemoryBufferRef(StringRef(bitcode[i].data(), bitcode[i].size()), objFiles[i]);
+        auto part = parseBitcodeFile(bitcodeRef, ctxt);
+        if(!part){
+            logAllUnhandledErrors(part.takeError(), errs(), "Codegen: ");
+            results[i] = 1;
+            return;
+        }
+        results[i] = emitObjFile(part->get(), objFiles[i]);
+    };
+
+    vector<std::thread> threads;
+    for(size_t i = 1; i < bitcode.size(); i++)
+        threads.emplace_back(emitPartition, i);
+    emitPartition(0);
+    for(auto &t : threads)
+        t.join();
+
+    auto end = high_resolution_clock::now();
+    if(showTimingInformation())
+        std::cout << "Writing " << bitcode.size() << " partitions: "
+                  << duration_cast<milliseconds>(end - start).count() << "ms\n";
+
+    if(std::any_of(results.begin(), results.end(), [](int res){ return res != 0; })){
+        for(auto &objFile : objFiles)
+            remove(objFile.c_str());
+        return {};
+    }
+    return objFiles;
+}
+
+
+int Compiler::compileIRtoBitcode(llvm::Module *mod, string const& outFile){
     using namespace std::chrono;
     auto start = high_resolution_clock::now();
 
-    string cmd = AN_LINKER " " + inFiles + " -o " + outFile;
-    int ret = system(cmd.c_str());
+    std::error_code ec;
+    raw_fd_ostream os{outFile, ec, llvm::sys::fs::F_None};
+    if(ec){
+        cerr << "Could not open " << outFile << ": " << ec.message() << endl;
+        return 1;
+    }
+
+    //Bitcode without a summary is linked with full LTO
+    if(ltoMode == LtoMode::Thin){
+        ProfileSummaryInfo psi{*mod};
+        auto index = buildModuleSummaryIndex(*mod, nullptr, &psi);
+        WriteBitcodeToFile(*mod, os, false, &index);
+    }else{
+        WriteBitcodeToFile(*mod, os);
+    }
+
+    auto end = high_resolution_clock::now();
+    if(showTimingInformation())
+        std::cout << "Writing .bc: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
+    return 0;
+}
+
+
+int Compiler::linkLto(vector<string> const& inFiles, string const& outFile, unsigned int optLvl, unsigned int threads){
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    //Each InputFile refers to its buffer so these must outlive the LTO object
+    vector<std::unique_ptr<MemoryBuffer>> buffers;
+
+    lto::Config conf;
+    conf.Options = getTargetOptions();
+    conf.RelocModel = Reloc::Model::PIC_;
+    conf.CGOptLevel = CodeGenOpt::Level::Aggressive;
+    conf.OptLevel = optLvl;
+    conf.UseNewPM = true;
+
+    threads = std::max(threads, 1u);
+    lto::LTO lto{std::move(conf), lto::createInProcessThinBackend(threads), threads};
+
+    vector<std::unique_ptr<lto::InputFile>> inputs;
+    for(auto &file : inFiles){
+        auto buffer = MemoryBuffer::getFile(file);
+        if(!buffer){
+            cerr << "Could not read " << file << ": " << buffer.getError().message() << endl;
+            return 1;
+        }
+
+        auto input = lto::InputFile::create((*buffer)->getMemBufferRef());
+        if(!input){
+            logAllUnhandledErrors(input.takeError(), errs(), "LTO: ");
+            return 1;
+        }
+        buffers.push_back(move(*buffer));
+        inputs.push_back(move(*input));
+    }
+
+    //Each symbol resolves to its strong definition, or to its first definition
+    //if every definition is weak.  Two strong definitions of one symbol are an error.
+    StringMap<pair<size_t, bool>> prevailing;
+    for(size_t i = 0; i < inputs.size(); i++){
+        for(auto &sym : inputs[i]->symbols()){
+            if(sym.isUndefined())
+                continue;
+
+            auto it = prevailing.insert({sym.getName(), {i, sym.isWeak()}});
+            auto &def = it.first->second;
+            if(it.second || sym.isWeak())
+                continue;
+
+            if(!def.second){
+                cerr << "Duplicate definition of " << sym.getName().str() << " in "
+                     << inFiles[def.first] << " and " << inFiles[i] << endl;
+                return 1;
+            }
+            def = {i, false};
+        }
+    }
+
+    //Only main must remain visible to the native objects the result is linked
+    //with, so every other definition can be internalized and removed once it is inlined.
+    for(size_t i = 0; i < inputs.size(); i++){
+        vector<lto::SymbolResolution> resolutions;
+        for(auto &sym : inputs[i]->symbols()){
+            lto::SymbolResolution res;
+            res.Prevailing = !sym.isUndefined() && prevailing[sym.getName()].first == i;
+            res.FinalDefinitionInLinkageUnit = res.Prevailing;
+            res.VisibleToRegularObj = sym.getName() == "main" || sym.isUsed();
+            resolutions.push_back(res);
+        }
+
+        if(auto err = lto.add(move(inputs[i]), resolutions)){
+            logAllUnhandledErrors(move(err), errs(), "LTO: ");
+            return 1;
+        }
+    }
+
+    //Tasks may run on separate threads but each only writes its own element
+    vector<string> objFiles(lto.getMaxTasks());
+    auto addStream = [&](unsigned task){
+        objFiles[task] = outFile + ".lto." + to_string(task) + ".o";
+
+        std::error_code ec;
+        auto os = llvm::make_unique<raw_fd_ostream>(objFiles[task], ec, llvm::sys::fs::F_None);
+        if(ec)
+            cerr << "Could not open " << objFiles[task] << ": " << ec.message() << endl;
+
+        return llvm::make_unique<lto::NativeObjectStream>(move(os));
+    };
+
+    auto cleanup = [&]{
+        for(auto &objFile : objFiles)
+            if(!objFile.empty())
+                remove(objFile.c_str());
+    };
+
+    if(auto err = lto.run(addStream)){
+        logAllUnhandledErrors(move(err), errs(), "LTO: ");
+        cleanup();
+        return 1;
+    }
+
+    auto end = high_resolution_clock::now();
+    if(showTimingInformation())
+        cout << "LTO: " << duration_cast<milliseconds>(end - start).count() << "ms\n";
+
+    objFiles.erase(std::remove(objFiles.begin(), objFiles.end(), ""), objFiles.end());
+    int ret = linkObj(objFiles, outFile);
+    cleanup();
+    return ret;
+}
+
+
+int Compiler::linkObj(vector<string> const& inFiles, string const& outFile){
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    auto linker = sys::findProgramByName(AN_LINKER);
+    if(!linker){
+        cerr << "Linker " AN_LINKER " was not found\n";
+        return 1;
+    }
+
+    //The linker is executed directly rather than through a shell
+    vector<StringRef> argv{*linker};
+    argv.insert(argv.end(), inFiles.begin(), inFiles.end());
+    argv.insert(argv.end(), {AN_LINKER_GC_FLAG, "-o", outFile});
+
+    string err;
+    int ret = sys::ExecuteAndWait(*linker, argv, None, {}, 0, 0, &err);
+    if(ret < 0)
+        cerr << "Failed to run " AN_LINKER ": " << err << endl;
 
     auto end = high_resolution_clock::now();
     if(showTimingInformation())
@@ -1069,6 +1699,7 @@ int Compiler::linkObj(string inFiles, string outFile){
 
 void Compiler::emitIR(){
     if(!compiled) compile();
+    if(errorCount()) return;
 
     std::error_code ec;
     auto&& fd = raw_fd_ostream(outFile + ".ll", ec, llvm::sys::fs::OpenFlags::F_Text);
@@ -1132,7 +1763,9 @@ string dirprefix(string &f){
  * @param llvmCtxt The llvmCtxt possibly shared with another module
  */
 Compiler::Compiler(const char *_fileName, bool lib, shared_ptr<LLVMContext> llvmCtxt) :
+        session(&CompilationSession::current()),
         ctxt(llvmCtxt ? llvmCtxt : shared_ptr<LLVMContext>(new LLVMContext())),
+        jit(new JitSession()),
         builder(*ctxt),
         compUnit(nullptr),
         compCtxt(new CompilerCtxt()),
@@ -1142,7 +1775,7 @@ Compiler::Compiler(const char *_fileName, bool lib, shared_ptr<LLVMContext> llvm
         isJIT(false),
         fileName(_fileName? _fileName : "(stdin)"),
         funcPrefix(""),
-        scope(0), optLvl(2), fnScope(1){
+        scope(0), optLvl(2), fnScope(1), codegenThreads(1), ltoMode(LtoMode::None){
 
     if(_fileName){
         string* fileName_cpy = new string(fileName);
@@ -1153,15 +1786,16 @@ Compiler::Compiler(const char *_fileName, bool lib, shared_ptr<LLVMContext> llvm
             //print out remaining errors
             int tok;
             yy::location loc;
-            while((tok = yylexer->next(&loc)) != Tok_Newline && tok != 0);
-            while(p.parse() != PE_OK && yylexer->peek() != 0);
+            while((tok = getLexer()->next(&loc)) != Tok_Newline && tok != 0);
+            while(p.parse() != PE_OK && getLexer()->peek() != 0);
 
-            fputs("Syntax error, aborting.\n", stderr);
-            exit(flag);
+            if(session->exitOnError){
+                fputs("Syntax error, aborting.\n", stderr);
+                exit(flag);
+            }
+        }else{
+            this->ast = parser::getRootNode();
         }
-
-        RootNode* root = parser::getRootNode();
-        this->ast = root;
     }
 
     //Add this module to the cache to ensure it is not compiled twice
@@ -1183,7 +1817,9 @@ Compiler::Compiler(const char *_fileName, bool lib, shared_ptr<LLVMContext> llvm
  * @param llvmCtxt The llvmCtxt shared from the parent Module
  */
 Compiler::Compiler(Compiler *c, Node *root, string modName, bool lib) :
+        session(c->session),
         ctxt(c->ctxt),
+        jit(c->jit),
         builder(*ctxt),
         compUnit(nullptr),
         compCtxt(new CompilerCtxt()),
@@ -1194,23 +1830,23 @@ Compiler::Compiler(Compiler *c, Node *root, string modName, bool lib) :
         fileName(c->fileName),
         outFile(modName),
         funcPrefix(""),
-        scope(0), optLvl(2), fnScope(1){
+        scope(0), optLvl(2), fnScope(1), codegenThreads(1), ltoMode(LtoMode::None){
 
     module.reset(new llvm::Module(outFile, *ctxt));
     this->ast = (RootNode*)root;
 }
 
-// TODO: Have a Context or Config class that is passed around
-//       to each visitor instead of having globals
-bool showTimingInformationGlobal = false;
 bool showTimingInformation() {
-    return showTimingInformationGlobal;
+    return CompilationSession::current().showTimingInformation;
 }
 
-void Compiler::processArgs(CompilerArgs *args){
+void Compiler::processArgs(CompilerArgs *args, bool run){
     string out = "";
     bool shouldGenerateExecutable = true;
-    showTimingInformationGlobal = args->hasArg(Args::Time);
+    CompilationSession::Scope scope{*session};
+    session->showTimingInformation = args->hasArg(Args::Time);
+
+    if(!ast) return;
 
     if(auto *arg = args->getArg(Args::OutputName)){
         outFile = arg->arg;
@@ -1225,6 +1861,28 @@ void Compiler::processArgs(CompilerArgs *args){
         else{ cerr << "Unrecognized OptLvl " << arg->arg << endl; return; }
     }
 
+    if(auto *arg = args->getArg(Args::CacheDir)){
+        uint64_t maxSizeBytes = 0;
+        if(auto *size = args->getArg(Args::CacheSize))
+            maxSizeBytes = std::max(atoll(size->arg.c_str()), 0LL) * 1024 * 1024;
+
+        objectCache = std::make_shared<ObjectCache>(arg->arg, maxSizeBytes);
+        jit->setCacheDir(arg->arg);
+    }
+
+    if(args->hasArg(Args::ThinLTO))
+        ltoMode = LtoMode::Thin;
+    else if(args->hasArg(Args::FullLTO))
+        ltoMode = LtoMode::Full;
+
+    if(auto *arg = args->getArg(Args::CtfeJitThreshold))
+        ctCtxt->jitThreshold = std::max(atoi(arg->arg.c_str()), 0);
+
+    //When compiling a single file, -j splits its codegen between threads instead
+    auto *jobs = args->getArg(Args::Jobs);
+    if(jobs && args->inputFiles.size() <= 1)
+        codegenThreads = std::max(atoi(jobs->arg.c_str()), 1);
+
 
     //make sure even non-called functions are included in the binary
     //if the -lib flag is set
@@ -1260,7 +1918,7 @@ void Compiler::processArgs(CompilerArgs *args){
     if(shouldGenerateExecutable){
         compileNative();
 
-        if(!errorCount() && args->hasArg(Args::CompileAndRun)){
+        if(run && !errorCount() && args->hasArg(Args::CompileAndRun)){
             int res = system((AN_EXEC_STR + outFile).c_str());
             if(res) return; //silence unused return result warning
         }
@@ -1268,10 +1926,8 @@ void Compiler::processArgs(CompilerArgs *args){
 }
 
 Compiler::~Compiler(){
-    if(yylexer){
-        delete yylexer;
-        yylexer = 0;
-    }
+    CompilationSession::Scope scope{*session};
+    setLexer(nullptr);
 }
 
 } //end of namespace ante
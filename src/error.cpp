@@ -2,14 +2,13 @@
 #include "target.h"
 #include "error.h"
 #include "types.h"
+#include "session.h"
 
 using namespace std;
 using namespace ante::parser;
 
 namespace ante {
 
-size_t globalErrorCount = 0;
-
 /*
  * Skips input in a given istream until it encounters the given coordinates,
  * with each newline signalling the end of a row.
@@ -33,26 +32,30 @@ void skipToLine(istream& ifs, unsigned int row){
     }
 }
 
+std::ostream& diagnostics(){
+    return *CompilationSession::current().diagnostics;
+}
+
 void printErrorTypeColor(ErrorType t){
-    if(colored_output){
+    if(coloredOutput()){
         if(t == ErrorType::Error)
-            cout << AN_ERR_COLOR;
+            diagnostics() << AN_ERR_COLOR;
         else if(t == ErrorType::Warning)
-            cout << AN_WARN_COLOR;
+            diagnostics() << AN_WARN_COLOR;
         else
-            cout << AN_NOTE_COLOR;
+            diagnostics() << AN_NOTE_COLOR;
     }
 }
 
 void clearColor(){
-    if(colored_output)
-        cout << AN_CONSOLE_RESET;
+    if(coloredOutput())
+        diagnostics() << AN_CONSOLE_RESET;
 }
 
 
 void setTermFGColor(AN_COLOR_TYPE fg){
-    if(colored_output)
-        cout << fg;
+    if(coloredOutput())
+        diagnostics() << fg;
 }
 
 /*
@@ -77,39 +80,39 @@ void printErrLine(const yy::location& loc, ErrorType t){
         if(i == loc.begin.column - 1){
             printErrorTypeColor(t);
         }else if(i == end_col){
-            cout << AN_CONSOLE_RESET;
+            diagnostics() << AN_CONSOLE_RESET;
         }
-        cout << s[i];
+        diagnostics() << s[i];
     }
 
     //draw arrow
-    if(!colored_output){
-        putchar('\n');
+    if(!coloredOutput()){
+        diagnostics() << '\n';
         printErrorTypeColor(t);
         unsigned int i = 1;
 
         //skip to begin pos and draw arrow until end pos
-        for(; i < loc.begin.column; i++) putchar(' ');
-        for(; i <= loc.end.column; i++) putchar('^');
+        for(; i < loc.begin.column; i++) diagnostics() << ' ';
+        for(; i <= loc.end.column; i++) diagnostics() << '^';
     }
 
     clearColor();
 }
 
 void printFileNameAndLineNumber(const yy::location& loc){
-    if(colored_output) cout << AN_CONSOLE_ITALICS;
+    if(coloredOutput()) diagnostics() << AN_CONSOLE_ITALICS;
 
-    if (loc.begin.filename) cout << *loc.begin.filename;
-    else cout << "(unknown file)";
+    if (loc.begin.filename) diagnostics() << *loc.begin.filename;
+    else diagnostics() << "(unknown file)";
 
     clearColor();
-    cout << ": ";
+    diagnostics() << ": ";
 
-    if(colored_output) cout << AN_CONSOLE_BOLD;
-    cout << loc.begin.line << ",";
+    if(coloredOutput()) diagnostics() << AN_CONSOLE_BOLD;
+    diagnostics() << loc.begin.line << ",";
 
-    if(loc.begin.column == loc.end.column) cout << loc.begin.column;
-    else cout << loc.begin.column << '-' << loc.end.column;
+    if(loc.begin.column == loc.end.column) diagnostics() << loc.begin.column;
+    else diagnostics() << loc.begin.column << '-' << loc.end.column;
 
     clearColor();
 }
@@ -118,33 +121,34 @@ void printFileNameAndLineNumber(const yy::location& loc){
 void showFileInfo(const yy::location &loc, ErrorType t){
     printFileNameAndLineNumber(loc);
 
-    cout << '\t' << flush;
+    diagnostics() << '\t' << flush;
     printErrorTypeColor(t);
 
     if(t == ErrorType::Error)
-        cout << "error: ";
+        diagnostics() << "error: ";
     else if(t == ErrorType::Warning)
-        cout << "warning: ";
+        diagnostics() << "warning: ";
     else if(t == ErrorType::Note)
-        cout << "note: ";
+        diagnostics() << "note: ";
 
     clearColor();
 }
 
 
-void showError(lazy_printer msg, const yy::location& loc, ErrorType t){
+void showError(lazy_printer msg, LOC_TY const& l, ErrorType t){
     if(t == ErrorType::Error)
-        globalErrorCount++;
+        CompilationSession::current().errorCount++;
 
+    yy::location loc = l.expand();
     showFileInfo(loc, t);
-    cout << msg << endl;
+    diagnostics() << msg << endl;
     printErrLine(loc, t);
-    cout << endl << endl;
+    diagnostics() << endl << endl;
 }
 
 
 size_t errorCount() {
-    return globalErrorCount;
+    return CompilationSession::current().errorCount;
 }
 
 
@@ -153,12 +157,12 @@ LOC_TY unknownLoc(){
 }
 
 
-void error(const char* msg, const yy::location& loc, ErrorType t){
+void error(const char* msg, LOC_TY const& loc, ErrorType t){
     showError(msg, loc, t);
     throw CtError();
 }
 
-void error(lazy_printer strs, const yy::location& loc, ErrorType t){
+void error(lazy_printer strs, LOC_TY const& loc, ErrorType t){
     showError(strs, loc, t);
     throw CtError();
 }
@@ -166,21 +170,21 @@ void error(lazy_printer strs, const yy::location& loc, ErrorType t){
 
 lazy_str typeNodeToColoredStr(const TypeNode *tn){
     lazy_str s = typeNodeToStr(tn);
-    if(colored_output)
+    if(coloredOutput())
         s.fmt = AN_TYPE_COLOR;
     return s;
 }
 
 lazy_str typeNodeToColoredStr(const unique_ptr<TypeNode>& tn){
     lazy_str s = typeNodeToStr(tn.get());
-    if(colored_output)
+    if(coloredOutput())
         s.fmt = AN_TYPE_COLOR;
     return s;
 }
 
 lazy_str anTypeToColoredStr(const AnType *t){
     lazy_str s = anTypeToStr(t);
-    if(colored_output)
+    if(coloredOutput())
         s.fmt = AN_TYPE_COLOR;
     return s;
 }
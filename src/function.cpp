@@ -81,6 +81,9 @@ TypedValue compFnWithModifiers(Compiler *c, FuncDecl *fd){
                 fn = c->compFn(fd);
                 if(!fn) return fn;
                 ((Function*)fn.val)->addFnAttr(Attribute::AttrKind::AlwaysInline);
+            }else if(vn->name == "pure"){
+                fn = c->compFn(fd);
+                fd->isPure = true;
             }else if(vn->name == "on_fn_decl"){
                 auto *rettn = (TypeNode*)fdn->returnType.get();
                 auto *fnty = AnFunctionType::get(toAnType(rettn, c->compUnit), fdn->params.get(), c->compUnit);
@@ -231,15 +234,28 @@ TypedValue Compiler::compFn(FuncDecl *fd){
     compCtxt->callStack.push_back(fd);
     auto *continueLabels = compCtxt->continueLabels.release();
     auto *breakLabels = compCtxt->breakLabels.release();
+    auto *stackSlots = compCtxt->stackSlots.release();
     compCtxt->continueLabels = llvm::make_unique<vector<BasicBlock*>>();
     compCtxt->breakLabels = llvm::make_unique<vector<BasicBlock*>>();
+    compCtxt->stackSlots = llvm::make_unique<StackSlots>();
+
+    auto restore = [&]{
+        compCtxt->callStack.pop_back();
+        compCtxt->continueLabels.reset(continueLabels);
+        compCtxt->breakLabels.reset(breakLabels);
+        compCtxt->stackSlots.reset(stackSlots);
+    };
 
     TMP_SET(this->fnScope, this->scope);
-    TypedValue ret = compFnHelper(this, fd);
+    TypedValue ret;
+    try{
+        ret = compFnHelper(this, fd);
+    }catch(CtError const& e){
+        restore();
+        throw e;
+    }
 
-    compCtxt->callStack.pop_back();
-    compCtxt->continueLabels.reset(continueLabels);
-    compCtxt->breakLabels.reset(breakLabels);
+    restore();
     return ret;
 }
 
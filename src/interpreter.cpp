@@ -0,0 +1,488 @@
+#include <llvm/ADT/SmallPtrSet.h>
+#include "interpreter.h"
+#include "scopeguard.h"
+#include "compapi.h"
+#include "tokens.h"
+#include "types.h"
+#include "util.h"
+
+using namespace std;
+using namespace llvm;
+using namespace ante::parser;
+
+namespace ante {
+
+    /** Interpreted calls nested deeper than this are left to the JIT */
+    const size_t maxCallDepth = 128;
+
+    /** Thrown by InterpretingVisitor::bailout, never escapes tryInterpret */
+    struct InterpreterBailout {};
+
+
+    bool isCompilerApiFn(FuncDecl *fd){
+        auto *fdn = fd->getFDN();
+        return !fdn->child && fdn->hasModifier(Tok_Ante) && capi::lookup(fd->getName());
+    }
+
+    bool isInterpretableOp(int op, AnType *l, AnType *r){
+        if(!l || !r || l->typeTag != r->typeTag)
+            return false;
+
+        bool isEq = op == Tok_EqEq || op == Tok_NotEq || op == Tok_Is || op == Tok_Isnt;
+        if(l->typeTag == TT_Bool)
+            return isEq;
+
+        return isNumericTypeTag(l->typeTag) && (isEq || op == '+' || op == '-' || op == '*'
+            || op == '/' || op == '%' || op == '<' || op == '>' || op == Tok_LesrEq || op == Tok_GrtrEq);
+    }
+
+    bool canInterpretFn(Compiler *c, FuncDecl *fd);
+
+    /**
+     * Checks an expression only uses the parts of the language the
+     * interpreter supports before any of it is evaluated, so that
+     * evaluation is rarely abandoned after a compiler API call has run.
+     */
+    struct InterpretabilityChecker {
+        Compiler *c;
+
+        /** Parameters and let bindings declared within the expression */
+        SmallPtrSet<Declaration*, 8> locals;
+
+        /** Set if the expression may call the compiler API, directly or not */
+        bool usesCompilerApi = false;
+
+        InterpretabilityChecker(Compiler *c) : c{c}{}
+
+        bool checkVar(Declaration *decl){
+            if(!decl || decl->isFuncDecl() || (decl->tval.type && decl->tval.type->hasModifier(Tok_Mut)))
+                return false;
+
+            if(locals.count(decl))
+                return true;
+
+            //Values defined outside the expression can only be used if they are already constant
+            auto *val = decl->tval.val ? getCtConstant(c, decl->tval.val) : nullptr;
+            return val && !isa<GlobalValue>(val);
+        }
+
+        bool checkCall(BinOpNode *n){
+            if(!n->decl || !n->decl->isFuncDecl() || n->decl->isTraitFuncDecl())
+                return false;
+
+            if(auto *tup = dynamic_cast<TupleNode*>(n->rval.get())){
+                for(auto &arg : tup->exprs)
+                    if(!check(arg.get()))
+                        return false;
+            }else if(!check(n->rval.get())){
+                return false;
+            }
+            auto *fd = static_cast<FuncDecl*>(n->decl);
+            if(!canInterpretFn(c, fd))
+                return false;
+
+            if(isCompilerApiFn(fd) || c->ctCtxt->callsCompilerApi.count(fd))
+                usesCompilerApi = true;
+            return true;
+        }
+
+        bool checkBinOp(BinOpNode *n){
+            switch(n->op){
+                case '(': return checkCall(n);
+                case Tok_And:
+                case Tok_Or: return check(n->lval.get()) && check(n->rval.get());
+                case ':': return check(n->lval.get());
+                case '.': return dynamic_cast<IntLitNode*>(n->rval.get()) && check(n->lval.get());
+                default:
+                    return isInterpretableOp(n->op, n->lval->getType(), n->rval->getType())
+                        && check(n->lval.get()) && check(n->rval.get());
+            }
+        }
+
+        bool check(Node *n){
+            if(dynamic_cast<IntLitNode*>(n) || dynamic_cast<FltLitNode*>(n) || dynamic_cast<BoolLitNode*>(n)
+                    || dynamic_cast<CharLitNode*>(n) || dynamic_cast<StrLitNode*>(n)){
+                return true;
+            }else if(auto *tup = dynamic_cast<TupleNode*>(n)){
+                for(auto &elem : tup->exprs)
+                    if(!check(elem.get()))
+                        return false;
+                return true;
+            }else if(auto *unop = dynamic_cast<UnOpNode*>(n)){
+                return (unop->op == '-' || unop->op == Tok_Not) && check(unop->rval.get());
+            }else if(auto *bop = dynamic_cast<BinOpNode*>(n)){
+                return checkBinOp(bop);
+            }else if(auto *seq = dynamic_cast<SeqNode*>(n)){
+                for(auto &stmt : seq->sequence)
+                    if(!check(stmt.get()))
+                        return false;
+                return true;
+            }else if(auto *block = dynamic_cast<BlockNode*>(n)){
+                return check(block->block.get());
+            }else if(auto *ifn = dynamic_cast<IfNode*>(n)){
+                return check(ifn->condition.get()) && check(ifn->thenN.get())
+                    && (!ifn->elseN || check(ifn->elseN.get()));
+            }else if(auto *var = dynamic_cast<VarNode*>(n)){
+                return checkVar(var->decl);
+            }else if(auto *assign = dynamic_cast<VarAssignNode*>(n)){
+                //Only immutable let bindings are supported
+                auto *var = dynamic_cast<VarNode*>(assign->ref_expr);
+                if(!var || assign->modifiers.empty() || assign->hasModifier(Tok_Mut) || !check(assign->expr.get()))
+                    return false;
+                locals.insert(var->decl);
+                return true;
+            }else if(auto *mod = dynamic_cast<ModNode*>(n)){
+                return mod->mod == Tok_Ante && mod->expr && check(mod->expr.get());
+            }
+            return false;
+        }
+    };
+
+
+    bool canInterpretFn(Compiler *c, FuncDecl *fd){
+        if(isCompilerApiFn(fd))
+            return true;
+
+        auto &interpretable = c->ctCtxt->interpretable;
+        auto it = interpretable.find(fd);
+        if(it != interpretable.end())
+            return it->second;
+
+        auto *fdn = fd->getFDN();
+        auto *fnTy = try_cast<AnFunctionType>(fdn->getType());
+        if(!fdn->child || fdn->varargs || !fnTy || fnTy->isGeneric){
+            interpretable[fd] = false;
+            return false;
+        }
+
+        //Recursive calls are assumed interpretable until the rest of fd is checked
+        interpretable[fd] = true;
+
+        InterpretabilityChecker checker{c};
+        if(fdn->params)
+            for(auto &param : *fdn->params)
+                checker.locals.insert(static_cast<NamedValNode&>(param).decl);
+
+        if(!checker.check(fdn->child.get())){
+            //Anything checked while fd was assumed interpretable must be checked again
+            vector<FuncDecl*> assumed;
+            for(auto &entry : interpretable)
+                if(entry.second)
+                    assumed.push_back(entry.first);
+            for(auto *f : assumed)
+                interpretable.erase(f);
+
+            interpretable[fd] = false;
+            return false;
+        }
+
+        if(checker.usesCompilerApi)
+            c->ctCtxt->callsCompilerApi.insert(fd);
+        return true;
+    }
+
+
+    TypedValue InterpretingVisitor::tryInterpret(Compiler *c, Node *n){
+        InterpretabilityChecker checker{c};
+        if(!checker.check(n))
+            return {};
+
+        InterpretingVisitor v{c};
+        try{
+            n->accept(v);
+        }catch(InterpreterBailout const&){
+            return {};
+        }
+        return v.val;
+    }
+
+    TypedValue InterpretingVisitor::tryInterpret(Compiler *c, FuncDecl *fd, vector<TypedValue> const& args){
+        for(auto &arg : args)
+            if(!isa<Constant>(arg.val))
+                return {};
+
+        if(!canInterpretFn(c, fd))
+            return {};
+
+        InterpretingVisitor v{c};
+        try{
+            auto ret = isCompilerApiFn(fd)
+                ? callCompilerApi(c, fd, args, fd->getLoc())
+                : v.call(fd, args, fd->getLoc());
+            c->ctCtxt->callsInterpreted++;
+            return ret;
+        }catch(InterpreterBailout const&){
+            return {};
+        }
+    }
+
+    TypedValue InterpretingVisitor::callCompilerApi(Compiler *c, FuncDecl *fd,
+            vector<TypedValue> const& args, LOC_TY const& loc){
+
+        capi::CtFunc *fn = capi::lookup(fd->getName());
+        if(!fn)
+            error("No compiler API function named " + fd->getName(), loc);
+
+        if(args.size() != fn->params.size())
+            error("Called function was given " + to_string(args.size()) + " argument"
+                + plural(args.size()) + " but was declared to take " + to_string(fn->params.size()), loc);
+
+        vector<AnteValue> a;
+        for(auto &arg : args)
+            a.emplace_back(c, arg);
+
+        TypedValue *res;
+        switch(a.size()){
+            case 0: res = (*fn)(c); break;
+            case 1: res = (*fn)(c, a[0]); break;
+            case 2: res = (*fn)(c, a[0], a[1]); break;
+            case 3: res = (*fn)(c, a[0], a[1], a[2]); break;
+            case 4: res = (*fn)(c, a[0], a[1], a[2], a[3]); break;
+            case 5: res = (*fn)(c, a[0], a[1], a[2], a[3], a[4]); break;
+            case 6: res = (*fn)(c, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+            default:
+                error("CtFuncs with more than 6 parameters are unimplemented", loc);
+                return {};
+        }
+
+        if(res){
+            TypedValue ret = *res;
+            delete res;
+            return ret;
+        }
+        return c->getUnitLiteral();
+    }
+
+    void InterpretingVisitor::bailout(){
+        throw InterpreterBailout{};
+    }
+
+    TypedValue InterpretingVisitor::call(FuncDecl *fd, vector<TypedValue> const& args, LOC_TY &loc){
+        auto &ctCtxt = *c->ctCtxt;
+
+        //Hot functions and deep recursion are left to the JIT unless a side effect already
+        //ran or may run.  JIT-compiled code cannot call back into the compiler.
+        bool mustInterpret = hadSideEffects || ctCtxt.callsCompilerApi.count(fd);
+        if(++ctCtxt.interpretedCalls[fd] > ctCtxt.jitThreshold && !mustInterpret)
+            bailout();
+
+        if(depth >= maxCallDepth){
+            if(!mustInterpret) bailout();
+            error("Compile-time evaluation exceeded the maximum call depth of " + to_string(maxCallDepth), loc);
+        }
+
+        TMP_SET(depth, depth + 1);
+        TMP_SET(bindings, Bindings{});
+
+        auto *fdn = fd->getFDN();
+        size_t i = 0;
+        if(fdn->params){
+            for(auto &param : *fdn->params){
+                auto *decl = static_cast<NamedValNode&>(param).decl;
+                if(isEmptyType(c, decl->tval.type))
+                    bindings[decl] = c->getUnitLiteral();
+                else if(i < args.size())
+                    bindings[decl] = args[i++];
+                else
+                    bailout();
+            }
+        }
+
+        fdn->child->accept(*this);
+        auto *retTy = try_cast<AnFunctionType>(fdn->getType())->retTy;
+        if(retTy->typeTag == TT_Unit)
+            return c->getUnitLiteral();
+        return {val.val, retTy};
+    }
+
+
+    void InterpretingVisitor::visit(RootNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(IntLitNode *n){
+        val = CompilingVisitor::compile(c, n);
+    }
+
+    void InterpretingVisitor::visit(FltLitNode *n){
+        val = CompilingVisitor::compile(c, n);
+    }
+
+    void InterpretingVisitor::visit(BoolLitNode *n){
+        val = CompilingVisitor::compile(c, n);
+    }
+
+    void InterpretingVisitor::visit(CharLitNode *n){
+        val = CompilingVisitor::compile(c, n);
+    }
+
+    void InterpretingVisitor::visit(ArrayNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(TupleNode *n){
+        if(n->exprs.empty()){
+            val = c->getUnitLiteral();
+            return;
+        }
+
+        auto vals = vecOf<Value*>(n->exprs.size());
+        for(auto &expr : n->exprs){
+            expr->accept(*this);
+            vals.push_back(val.val);
+        }
+        val = TypedValue(c->tupleOf(vals, false), n->getType());
+    }
+
+    void InterpretingVisitor::visit(UnOpNode *n){
+        n->rval->accept(*this);
+
+        if(n->op == '-' && isNumericTypeTag(val.type->typeTag)){
+            val.val = val.type->isFloatTy()
+                ? c->builder.CreateFNeg(val.val)
+                : c->builder.CreateNeg(val.val);
+        }else if(n->op == Tok_Not && val.type->typeTag == TT_Bool){
+            val.val = c->builder.CreateNot(val.val);
+        }else{
+            bailout();
+        }
+    }
+
+    void InterpretingVisitor::visit(BinOpNode *n){
+        if(n->op == '('){
+            vector<TypedValue> args;
+            auto evalArg = [&](Node *arg){
+                arg->accept(*this);
+                if(!isEmptyType(c, val.type))
+                    args.push_back(val);
+            };
+
+            if(auto *tup = dynamic_cast<TupleNode*>(n->rval.get())){
+                for(auto &arg : tup->exprs)
+                    evalArg(arg.get());
+            }else{
+                evalArg(n->rval.get());
+            }
+
+            auto *fd = static_cast<FuncDecl*>(n->decl);
+            if(isCompilerApiFn(fd)){
+                hadSideEffects = true;
+                val = callCompilerApi(c, fd, args, n->loc);
+            }else{
+                val = call(fd, args, n->loc);
+            }
+            return;
+        }else if(n->op == Tok_And || n->op == Tok_Or){
+            //short circuit, the rval is only evaluated if the lval does not determine the result
+            n->lval->accept(*this);
+            if(cast<ConstantInt>(val.val)->isOne() == (n->op == Tok_And))
+                n->rval->accept(*this);
+            return;
+        }else if(n->op == ':'){
+            n->lval->accept(*this);
+            val.type = n->getType();
+            return;
+        }else if(n->op == '.'){
+            n->lval->accept(*this);
+            auto index = atoi(static_cast<IntLitNode*>(n->rval.get())->val.c_str());
+            auto *elem = cast<Constant>(val.val)->getAggregateElement(index);
+            if(!elem) bailout();
+            val = TypedValue(elem, n->getType());
+            return;
+        }
+
+        n->lval->accept(*this);
+        TypedValue lhs = val;
+        n->rval->accept(*this);
+        TypedValue rhs = val;
+
+        if((n->op == '/' || n->op == '%') && !rhs.type->isFloatTy()){
+            if(cast<Constant>(rhs.val)->isNullValue())
+                error("Division by zero in compile-time code", n->loc);
+
+            //the minimum value of a signed integer divided by -1 overflows
+            if(isSignedTypeTag(rhs.type->typeTag) && cast<Constant>(rhs.val)->isAllOnesValue()
+                    && isa<ConstantInt>(lhs.val) && cast<ConstantInt>(lhs.val)->getValue().isMinSignedValue())
+                error("Signed integer overflow in compile-time division", n->loc);
+        }
+
+        if(lhs.type->typeTag == TT_Bool){
+            bool eq = n->op == Tok_EqEq || n->op == Tok_Is;
+            val = TypedValue(eq ? c->builder.CreateICmpEQ(lhs.val, rhs.val)
+                                : c->builder.CreateICmpNE(lhs.val, rhs.val), AnType::getBool());
+        }else{
+            val = handlePrimitiveNumericOp(n->op, c, lhs, rhs);
+        }
+
+        if(!isa<Constant>(val.val))
+            bailout();
+    }
+
+    void InterpretingVisitor::visit(SeqNode *n){
+        for(auto &stmt : n->sequence)
+            stmt->accept(*this);
+    }
+
+    void InterpretingVisitor::visit(BlockNode *n){
+        n->block->accept(*this);
+    }
+
+    void InterpretingVisitor::visit(ModNode *n){
+        n->expr->accept(*this);
+    }
+
+    void InterpretingVisitor::visit(TypeNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(TypeCastNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(RetNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(NamedValNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(VarNode *n){
+        auto it = bindings.find(n->decl);
+        if(it != bindings.end()){
+            val = it->second;
+        }else if(auto *ctval = n->decl->tval.val ? getCtConstant(c, n->decl->tval.val) : nullptr){
+            val = {ctval, n->decl->tval.type};
+        }else{
+            bailout();
+        }
+    }
+
+    void InterpretingVisitor::visit(StrLitNode *n){
+        val = CompilingVisitor::compile(c, n);
+    }
+
+    void InterpretingVisitor::visit(VarAssignNode *n){
+        n->expr->accept(*this);
+        bindings[static_cast<VarNode*>(n->ref_expr)->decl] = val;
+    }
+
+    void InterpretingVisitor::visit(ExtNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(ImportNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(JumpNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(WhileNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(ForNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(MatchBranchNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(MatchNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(IfNode *n){
+        n->condition->accept(*this);
+        if(cast<ConstantInt>(val.val)->isOne()){
+            n->thenN->accept(*this);
+        }else if(n->elseN){
+            n->elseN->accept(*this);
+        }else{
+            val = c->getUnitLiteral();
+        }
+    }
+
+    void InterpretingVisitor::visit(FuncDeclNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(DataDeclNode *n){ bailout(); }
+
+    void InterpretingVisitor::visit(TraitNode *n){ bailout(); }
+}
@@ -0,0 +1,209 @@
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <iostream>
+
+#include "jit.h"
+#include "objcache.h"
+#include "target.h"
+
+using namespace std;
+using namespace llvm;
+
+namespace ante {
+    JitObjectCache::JitObjectCache(string const& dir)
+        : dir{dir}, hits{0}, misses{0}{}
+
+    string JitObjectCache::getObjPath(const Module *module) const {
+        SmallString<128> path{dir};
+        sys::path::append(path, "llvmcache-jit-" + module->getModuleIdentifier() + ".o");
+        return path.str().str();
+    }
+
+    void JitObjectCache::notifyObjectCompiled(const Module *module, MemoryBufferRef obj){
+        writeCacheEntry(dir, getObjPath(module), obj.getBuffer());
+    }
+
+    unique_ptr<MemoryBuffer> JitObjectCache::getObject(const Module *module){
+        auto buffer = MemoryBuffer::getFile(getObjPath(module));
+        if(!buffer){
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        return move(*buffer);
+    }
+
+
+    JitSession::JitSession()
+        : jit{}, tsctxt{llvm::make_unique<LLVMContext>()}, definitions{}, entryCount{0},
+          modulesAdded{0}, definitionsAdded{0}, definitionsReused{0}, timeSpent{0}{}
+
+
+    orc::JITTargetMachineBuilder getTargetMachineBuilder(){
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+
+        auto triple = Triple(AN_NATIVE_ARCH, AN_NATIVE_VENDOR, AN_NATIVE_OS);
+        return orc::JITTargetMachineBuilder{triple};
+    }
+
+
+    void JitSession::init(){
+        auto b = getTargetMachineBuilder();
+        auto dl = getDataLayout();
+
+        jit = cantFail(orc::LLLazyJIT::Create(b, dl));
+
+        // Let compile-time code call into libc and the compiler's own C API
+        jit->getMainJITDylib().setGenerator(
+            cantFail(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(dl)));
+
+        // Only used to compile modules eagerly when there is a cache
+        targetMachine = cantFail(b.createTargetMachine());
+    }
+
+
+    DataLayout const& JitSession::getDataLayout(){
+        if(!dataLayout){
+            auto dl = cantFail(getTargetMachineBuilder().getDefaultDataLayoutForTarget());
+            dataLayout = llvm::make_unique<DataLayout>(dl);
+        }
+        return *dataLayout;
+    }
+
+
+    void JitSession::setCacheDir(string const& dir){
+        objectCache = llvm::make_unique<JitObjectCache>(dir);
+    }
+
+
+    /** Hash a module's bitcode along with everything else that changes the code compiled from it */
+    string getCacheKey(StringRef bitcode, TargetMachine const& tm){
+        MD5 md5;
+        md5.update(compilerIdentity());
+        md5.update(tm.getTargetTriple().str());
+        md5.update(bitcode);
+
+        MD5::MD5Result result;
+        md5.final(result);
+        return result.digest().str().str();
+    }
+
+
+    /** True if f has a body and every block in it has been terminated */
+    bool isCompleteFunction(const Function *f){
+        if(f->empty())
+            return false;
+
+        for(auto &bb : *f){
+            if(!bb.getTerminator())
+                return false;
+        }
+        return true;
+    }
+
+
+    void* JitSession::addModuleAndLookup(Module const& module, Function *entry){
+        using namespace std::chrono;
+        auto start = high_resolution_clock::now();
+
+        if(!jit) init();
+
+        // Local definitions cannot be referenced from another module so
+        // they are cloned every time.  Everything else already in the JIT
+        // is left as a declaration and resolved by name.
+        auto shouldClone = [&](const GlobalValue *gv){
+            if(gv == entry)
+                return true;
+
+            auto *f = dyn_cast<Function>(gv);
+            if(f && !isCompleteFunction(f))
+                return false;
+
+            if(!gv->hasLocalLinkage() && definitions.count(gv->getName())){
+                definitionsReused++;
+                return false;
+            }
+            return true;
+        };
+
+        ValueToValueMapTy vmap;
+        auto clone = CloneModule(module, vmap, shouldClone);
+
+        string entryName = "AnteCall." + to_string(entryCount++);
+        auto *entryClone = cast<Function>(vmap[entry]);
+        entryClone->setName(entryName);
+        entryClone->setLinkage(GlobalValue::ExternalLinkage);
+
+        for(auto &gv : clone->global_values()){
+            if(!gv.isDeclaration() && !gv.hasLocalLinkage() && &gv != entryClone){
+                definitions.insert(gv.getName());
+                definitionsAdded++;
+            }
+        }
+
+        // The compiler's LLVMContext is not owned by the JIT, so the new
+        // module is moved into the JIT's own context through bitcode.
+        SmallVector<char, 0> buffer;
+        raw_svector_ostream os{buffer};
+        WriteBitcodeToFile(*clone, os);
+
+        auto bitcode = MemoryBufferRef(StringRef(buffer.data(), buffer.size()), entryName);
+        auto parsed = parseBitcodeFile(bitcode, *tsctxt.getContext());
+        if(!parsed){
+            logAllUnhandledErrors(parsed.takeError(), errs(), "JIT: ");
+            return nullptr;
+        }
+
+        // With a cache the module is compiled now so its object can be loaded
+        // next time, otherwise the JIT compiles each function on first call
+        auto addCompiledModule = [&](Module &mod){
+            mod.setModuleIdentifier(getCacheKey(bitcode.getBuffer(), *targetMachine));
+
+            auto lock = tsctxt.getLock();
+            auto obj = orc::SimpleCompiler(*targetMachine, objectCache.get())(mod);
+            return jit->addObjectFile(move(obj));
+        };
+
+        auto err = objectCache
+            ? addCompiledModule(**parsed)
+            : jit->addLazyIRModule(orc::ThreadSafeModule(move(*parsed), tsctxt));
+
+        if(err){
+            logAllUnhandledErrors(move(err), errs(), "JIT: ");
+            return nullptr;
+        }
+        modulesAdded++;
+
+        auto symbol = jit->lookup(entryName);
+        timeSpent += high_resolution_clock::now() - start;
+
+        if(!symbol){
+            logAllUnhandledErrors(symbol.takeError(), errs(), "JIT: ");
+            return nullptr;
+        }
+        return (void*)symbol->getAddress();
+    }
+
+
+    void JitSession::printStatistics() const {
+        using namespace std::chrono;
+        cout << "JIT: " << duration_cast<milliseconds>(timeSpent).count() << "ms\n";
+        cout << "    Modules added:      " << modulesAdded << '\n';
+        cout << "    Definitions added:  " << definitionsAdded << '\n';
+        cout << "    Definitions reused: " << definitionsReused << '\n';
+        if(objectCache){
+            cout << "    Objects cached:     " << objectCache->hits << '\n';
+            cout << "    Objects compiled:   " << objectCache->misses << '\n';
+        }
+    }
+}
@@ -1,12 +1,15 @@
 #include "lazystr.h"
+#include "session.h"
 using namespace ante;
 using namespace std;
 
 namespace ante {
-    extern bool colored_output;
+    bool coloredOutput(){
+        return CompilationSession::current().coloredOutput;
+    }
 
     ostream& operator<<(ostream& os, lazy_str const& str) {
-        if (colored_output)
+        if (coloredOutput())
             os << str.fmt << str.s << AN_CONSOLE_RESET;
         else
             os << str.s;
@@ -106,7 +109,7 @@ namespace ante {
     }
 
     std::ostream& operator<<(std::ostream& os, win_console_color color) {
-        if (colored_output) {
+        if (coloredOutput()) {
             os.flush();
             setcolor(color, getBackgroundColor());
         }
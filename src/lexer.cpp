@@ -1,5 +1,6 @@
 #include "lexer.h"
 #include "lazystr.h"
+#include "session.h"
 #include <cstdlib>
 #include <cstring>
 
@@ -114,7 +115,7 @@ map<int, const char*> tokDict = {
 /*
  *  Maps each keyword to its corresponding TokenType
  */
-map<string, int> keywords = {
+llvm::StringMap<int> keywords = {
     {"i8",       Tok_I8},
     {"i16",      Tok_I16},
     {"i32",      Tok_I32},
@@ -181,22 +182,21 @@ map<string, int> keywords = {
 
 
 /* Raw text to store identifiers and usertypes in */
-char *lextxt;
+thread_local char *lextxt;
 
-Lexer *yylexer;
-
-bool ante::colored_output = true;
+Lexer* getLexer(){
+    return CompilationSession::current().lexer;
+}
 
 /* Sets lexer instance for yylex to use */
 void setLexer(Lexer *l){
-    if(yylexer)
-        delete yylexer;
-
-    yylexer = l;
+    auto &session = CompilationSession::current();
+    delete session.lexer;
+    session.lexer = l;
 }
 
 int yylex(yy::parser::semantic_type* st, yy::location* yyloc){
-    return yylexer->next(yyloc);
+    return getLexer()->next(yyloc);
 }
 
 
@@ -206,40 +206,33 @@ int yylex(yy::parser::semantic_type* st, yy::location* yyloc){
  * If file = nullptr then stdin will be opened instead
  */
 Lexer::Lexer(string* file) :
-    isPseudoFile{false},
     interpolationLevel{0},
     unfinishedStrLiteral{false},
     row{1},
     col{1},
     rowOffset{0},
     colOffset{0},
-    cur{0},
-    nxt{0},
     scopes{new stack<unsigned int>()},
     cscope{0},
     manualScopeLevel{0},
     shouldReturnNewline{false},
     printInput{false}
 {
-    if(file){
-        in = new ifstream(*file);
-        fileName = file;
-    }else{
-        in = &cin;
-        fileName = new string("stdin");
-    }
+    fileName = file ? file : new string("stdin");
 
-    if(!*in){
-        cerr << "Error: Unable to open file '" << *file << "'\n";
+    auto buffer = llvm::MemoryBuffer::getFileOrSTDIN(file ? *file : "-");
+    if(!buffer){
+        cerr << "Error: Unable to open file '" << *fileName << "'\n";
         exit(EXIT_FAILURE);
     }
+    source = move(*buffer);
 
-    incPos(2);
+    loadBuffer(source->getBufferStart(), source->getBufferEnd());
     row = col = 1;
     scopes->push(0);
 
     if(cur == '#' && nxt == '!')
-        while(cur != '\n') incPos();
+        while(cur != '\n' && cur != '\0') incPos();
 }
 
 
@@ -249,15 +242,12 @@ Lexer::Lexer(string* file) :
  */
 Lexer::Lexer(string* fName, string& pFile,
         unsigned int ro, unsigned int co, bool pi) :
-    isPseudoFile{true},
     interpolationLevel{0},
     unfinishedStrLiteral{false},
     row{1},
     col{1},
     rowOffset{ro},
     colOffset{co},
-    cur{1}, //Cannot initialize cur=nxt=0 as 0 is treated as end of file for a pseudo-file
-    nxt{1},
     scopes{new stack<unsigned int>()},
     cscope{0},
     manualScopeLevel{0},
@@ -265,15 +255,12 @@ Lexer::Lexer(string* fName, string& pFile,
     printInput{pi}
 {
     fileName = fName;
-    pseudoFile = (char*)pFile.c_str();
-    incPos(2);
+    loadBuffer(pFile.data(), pFile.data() + pFile.size());
     scopes->push(0);
 }
 
 Lexer::~Lexer(){
     delete scopes;
-    if(!isPseudoFile && in != &cin)
-        delete in;
 }
 
 char Lexer::peek() const{
@@ -318,19 +305,26 @@ string Lexer::getTokStr(int t){
     return s;
 }
 
+/*
+ * Starts lexing the contiguous buffer [begin, end) by loading its
+ * first two characters into cur and nxt.  A null character, either
+ * at the end of the buffer or within it, marks the end of input.
+ */
+void Lexer::loadBuffer(const char *begin, const char *end){
+    this->end = end;
+    pos = begin;
+    cur = pos != end ? *pos : 0;
+    if(pos != end) pos++;
+    nxt = cur && pos != end ? *pos : 0;
+    col += 2;
+}
+
 inline void Lexer::incPos(){
     cur = nxt;
     col++;
 
-    if(isPseudoFile){
-        nxt = !nxt ? 0 : *(pseudoFile++);
-    }else{
-        if(in->good()){
-            in->get(nxt);
-        }else {
-            cur = nxt = 0;
-        }
-    }
+    if(pos != end) pos++;
+    nxt = cur && pos != end ? *pos : 0;
 }
 
 void Lexer::incPos(int end){
@@ -339,6 +333,11 @@ void Lexer::incPos(int end){
     }
 }
 
+/* Location of cur within the buffer, or the end of input once cur is 0 */
+inline const char* Lexer::curPtr() const {
+    return cur ? pos - 1 : pos;
+}
+
 unsigned int Lexer::getManualScopeLevel() const {
     return manualScopeLevel;
 }
@@ -407,12 +406,18 @@ int Lexer::handleComment(yy::parser::location_type* loc){
 *  should always be stored in a node during parsing
 *  and freed later.
 */
+void Lexer::setlextxt(const char *str, size_t len){
+    lextxt = (char*)malloc(len + 1);
+    memcpy(lextxt, str, len);
+    lextxt[len] = '\0';
+}
+
 void Lexer::setlextxt(string &str){
-    lextxt = strdup(str.c_str());
+    setlextxt(str.c_str(), str.length());
 }
 
 int Lexer::genAlphaNumTok(yy::parser::location_type* loc){
-    string s = "";
+    const char *start = curPtr();
     loc->begin = getPos();
 
     bool isUsertype = cur >= 'A' && cur <= 'Z';
@@ -422,26 +427,25 @@ int Lexer::genAlphaNumTok(yy::parser::location_type* loc){
                 loc->end = getPos();
                 lexErr("Usertypes cannot contain an underscore.", loc);
             }
-
-            s += cur;
             incPos();
         }
     }else{
         while(IS_ALPHANUM(cur)){
-            s += cur;
             incPos();
         }
     }
 
+    //identifiers are never escaped so their text is taken straight from the buffer
+    llvm::StringRef s{start, (size_t)(curPtr() - start)};
     loc->end = getPos(false);
 
     if(isUsertype){
         if(printInput)
-            cout << AN_TYPE_COLOR << s << AN_CONSOLE_RESET;
-        setlextxt(s);
+            cout << AN_TYPE_COLOR << s.str() << AN_CONSOLE_RESET;
+        setlextxt(s.data(), s.size());
         return Tok_UserType;
     }else{ //ident or keyword
-        auto key = keywords.find(s.c_str());
+        auto key = keywords.find(s);
         if(key != keywords.end()){
             if(printInput){
                 if(isKeywordAType(key->second))
@@ -450,13 +454,13 @@ int Lexer::genAlphaNumTok(yy::parser::location_type* loc){
                     cout << AN_CONSTANT_COLOR;
                 else cout << AN_KEYWORD_COLOR;
 
-                cout << key->first << AN_CONSOLE_RESET;
+                cout << key->first().str() << AN_CONSOLE_RESET;
             }
             return key->second;
         }else{//ident
             if(printInput)
-                cout << s;
-            setlextxt(s);
+                cout << s.str();
+            setlextxt(s.data(), s.size());
             return Tok_Ident;
         }
     }
@@ -658,7 +662,8 @@ int Lexer::genStrLitTokNoOpenQuotes(yy::parser::location_type* loc, TokenType to
                         cha += cur - '0';
 
                         s += cha;
-                        in->putback(nxt);
+                        //step back so nxt is read again after the final digit
+                        pos--;
                         nxt = cur;
                     }
                     break;
@@ -777,7 +782,8 @@ int Lexer::genCharLitTok(yy::parser::location_type* loc){
                     cha += cur - '0';
 
                     s += cha;
-                    in->putback(nxt);
+                    //step back so nxt is read again after the final digit
+                    pos--;
                     nxt = cur;
                 }
                 break;
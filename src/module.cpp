@@ -6,12 +6,11 @@
 #include "trait.h"
 #include "unification.h"
 #include "util.h"
+#include "session.h"
 
 namespace ante {
-    Module rootModule{""};
-
     Module& Module::getRoot(){
-        return rootModule;
+        return *CompilationSession::current().rootModule;
     }
 
     llvm::StringMap<Module>::iterator Module::findChild(std::string const& name) {
@@ -110,29 +109,132 @@ namespace ante {
         return nullptr;
     }
 
+    size_t TypeArgsHash::operator()(TypeArgs const& args) const {
+        return hashAll(args);
+    }
+
+    /**
+     * Hash the head type constructor of t into hash, eg. the name of a
+     * data type or the arity of a tuple.  Returns false if the head is a
+     * type variable, in which case t may unify with any type.
+     */
+    bool hashHeadConstructor(const AnType *t, size_t &hash){
+        if(t->typeTag == TT_TypeVar)
+            return false;
+
+        size_t head = t->typeTag;
+        if(auto dt = try_cast<AnDataType>(t)){
+            head = hashCombine(head, std::hash<std::string>()(dt->name));
+        }else if(auto tup = try_cast<AnTupleType>(t)){
+            if(!tup->fields.empty() && tup->fields.back()->isRowVar())
+                return false;
+            head = hashCombine(head, tup->fields.size());
+        }else if(auto fn = try_cast<AnFunctionType>(t)){
+            head = hashCombine(head, fn->paramTys.size());
+        }
+        hash = hashCombine(hash, head);
+        return true;
+    }
+
+    /** Hash the head constructor of each type.  Returns false if any is a type variable. */
+    bool hashHeadConstructors(TypeArgs const& typeArgs, size_t &hash){
+        hash = typeArgs.size();
+        for(auto *t : typeArgs){
+            if(!hashHeadConstructor(t, hash))
+                return false;
+        }
+        return true;
+    }
+
+    void Module::addTraitImpl(std::string const& name, TraitImpl *impl){
+        traitImpls[name].push_back(impl);
+        CompilationSession::current().implsAdded++;
+    }
+
+    void Module::addImport(Module *import){
+        imports.push_back(import);
+        CompilationSession::current().implsAdded++;
+    }
+
+    TraitImplIndex& Module::getTraitImplIndex(std::string const& name) const {
+        size_t implsAdded = CompilationSession::current().implsAdded;
+        if(traitImplIndicesVersion != implsAdded){
+            traitImplIndices.clear();
+            traitImplIndicesVersion = implsAdded;
+        }
+
+        auto it = traitImplIndices.find(name);
+        if(it != traitImplIndices.end())
+            return it->getValue();
+
+        TraitImplIndex &index = traitImplIndices[name];
+        auto addImpls = [&](const Module *module){
+            auto it = module->traitImpls.find(name);
+            if(it == module->traitImpls.end())
+                return;
+
+            for(auto *impl : it->getValue()){
+                size_t key;
+                if(hashHeadConstructors(impl->typeArgs, key)){
+                    index.byHead[key].push_back(index.impls.size());
+                }else{
+                    index.generic.push_back(index.impls.size());
+                }
+                index.impls.push_back(impl);
+            }
+        };
+
+        addImpls(this);
+        for(Module *import : this->imports)
+            addImpls(import);
+
+        return index;
+    }
+
     /** Lookup the given TraitInstance* and return it if found, null otherwise */
     TraitImpl* Module::lookupTraitImpl(std::string const& name, TypeArgs const& typeArgs) const {
-        auto it = traitImpls.find(name);
-        if(it != traitImpls.end()){
-            for(auto *impl : it->getValue()){
-                auto pair = tryUnify(impl->typeArgs, typeArgs);
-                if(pair.first){
-                    return impl;
+        TraitImplIndex &index = getTraitImplIndex(name);
+
+        auto memo = index.resolved.find(typeArgs);
+        if(memo != index.resolved.end())
+            return memo->second;
+
+        auto matches = [&](size_t i){
+            return tryUnify(index.impls[i]->typeArgs, typeArgs).first;
+        };
+
+        TraitImpl *result = nullptr;
+        size_t key;
+        if(hashHeadConstructors(typeArgs, key)){
+            // Only impls with the same heads or a type variable head can match.
+            // Both lists are sorted, so merge them to keep the same precedence
+            // as trying every impl in order.
+            static const std::vector<size_t> noImpls;
+            auto bucket = index.byHead.find(key);
+            auto &exact = bucket != index.byHead.end() ? bucket->second : noImpls;
+            auto &generic = index.generic;
+
+            size_t i = 0, j = 0;
+            while(i < exact.size() || j < generic.size()){
+                size_t next = j == generic.size() || (i < exact.size() && exact[i] < generic[j])
+                    ? exact[i++] : generic[j++];
+
+                if(matches(next)){
+                    result = index.impls[next];
+                    break;
                 }
             }
-        }
-        for(Module *import : this->imports){
-            auto it = import->traitImpls.find(name);
-            if(it != import->traitImpls.end()){
-                for(auto *impl : it->getValue()){
-                    auto pair = tryUnify(impl->typeArgs, typeArgs);
-                    if(pair.first){
-                        return impl;
-                    }
+        }else{
+            for(size_t i = 0; i < index.impls.size(); i++){
+                if(matches(i)){
+                    result = index.impls[i];
+                    break;
                 }
             }
         }
-        return nullptr;
+
+        index.resolved[typeArgs] = result;
+        return result;
     }
 
     /** Lookup the TraitDecl and return a new, unimplemented instance of it */
@@ -13,8 +13,8 @@
 
 using namespace std;
 
-//yy::locations stored in all Nodes contain a string* to
-//a filename which must not be freed until all nodes are
+//SourceLocs stored in all Nodes refer to these filenames
+//through the session's file table so they must not be freed until all nodes are
 //deleted, including the FuncDeclNodes within ante::Modules
 //that all have a static lifetime
 list<string> fileNames;
@@ -635,8 +635,8 @@ namespace ante {
             //print out remaining errors
             int tok;
             yy::location loc;
-            while((tok = yylexer->next(&loc)) != Tok_Newline && tok != 0);
-            while(p.parse() != PE_OK && yylexer->peek() != 0);
+            while((tok = getLexer()->next(&loc)) != Tok_Newline && tok != 0);
+            while(p.parse() != PE_OK && getLexer()->peek() != 0);
 
             cerr << "Syntax error, aborting.\n";
             exit(flag);
@@ -710,11 +710,11 @@ namespace ante {
                 checkForConflict(import, mod, loc);
             }
 
-            compUnit->imports.push_back(import);
+            compUnit->addImport(import);
         }else{
             //module not found
             NameResolutionVisitor newVisitor = visitImport(fullPath, modPath);
-            compUnit->imports.push_back(newVisitor.compUnit);
+            compUnit->addImport(newVisitor.compUnit);
         }
     }
 
@@ -853,7 +853,7 @@ namespace ante {
 
             auto impl = new TraitImpl(decl, args);
             impl->impl = n;
-            compUnit->traitImpls[traitName].push_back(impl);
+            compUnit->addTraitImpl(traitName, impl);
         }
     }
 
@@ -958,10 +958,10 @@ namespace ante {
 
     void NameResolutionVisitor::visitUnionDecl(parser::DataDeclNode *decl){
         auto generics = convertToTypeArgs(decl->generics, compUnit);
-        auto data = AnDataType::get(decl->name, generics, nullptr);
-        TypeDecl &typeDecl = define(decl->name, data, decl->loc);
+        TypeDecl &typeDecl = define(decl->name, nullptr, decl->loc);
+        auto data = AnDataType::get(decl->name, generics, &typeDecl);
+        typeDecl.type = data;
         typeDecl.isUnionType = true;
-        data->decl = &typeDecl;
 
         for(Node& child : *decl->child){
             auto nvn = static_cast<NamedValNode*>(&child);
@@ -999,11 +999,17 @@ namespace ante {
         auto *nvn = (NamedValNode*)n->child.get();
         assert(nvn);
 
-        auto data = AnDataType::get(n->name, convertToTypeArgs(n->generics, compUnit), nullptr);
-        TypeDecl &typeDecl = define(n->name, data, n->loc);
-        data->decl = &typeDecl;
+        TypeDecl &typeDecl = define(n->name, nullptr, n->loc);
+        auto data = AnDataType::get(n->name, convertToTypeArgs(n->generics, compUnit), &typeDecl);
+        typeDecl.type = data;
         // typeDecl->isAlias = n->isAlias;
 
+        for(auto &mod : n->modifiers){
+            auto *vn = mod->isCompilerDirective() ? dynamic_cast<VarNode*>(mod->directive.get()) : nullptr;
+            if(vn && vn->name == "counted_iterator")
+                typeDecl.isCountedIterator = true;
+        }
+
         while(nvn){
             TypeNode *tyn = (TypeNode*)nvn->typeExpr.get();
             auto ty = toAnType(tyn, compUnit);
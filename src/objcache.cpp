@@ -0,0 +1,201 @@
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+
+#include "objcache.h"
+#include "target.h"
+
+using namespace std;
+using namespace llvm;
+
+namespace ante {
+    std::atomic<size_t> cacheHits{0};
+    std::atomic<size_t> cacheMisses{0};
+
+    /** Return the hex MD5 of the contents of the given file, or an empty string if it cannot be read */
+    string hashFile(string const& path){
+        auto buffer = MemoryBuffer::getFile(path);
+        if(!buffer)
+            return "";
+
+        MD5 md5;
+        md5.update((*buffer)->getBuffer());
+        MD5::MD5Result result;
+        md5.final(result);
+        return result.digest().str().str();
+    }
+
+    /**
+     * Identifies the running compiler binary by its path, size, and
+     * modification time so rebuilding the compiler invalidates the cache.
+     */
+    string const& compilerIdentity(){
+        static const string identity = []{
+            string exe = sys::fs::getMainExecutable(nullptr, (void*)&hashFile);
+            sys::fs::file_status status;
+            if(sys::fs::status(exe, status))
+                return exe;
+
+            return exe + ":" + to_string(status.getSize()) + ":"
+                + to_string(status.getLastModificationTime().time_since_epoch().count());
+        }();
+        return identity;
+    }
+
+
+    ObjectCache::ObjectCache(string const& dir, uint64_t maxSizeBytes)
+        : dir{dir}, maxSizeBytes{maxSizeBytes}{}
+
+    string ObjectCache::getManifestPath(string const& key) const {
+        SmallString<128> path{dir};
+        sys::path::append(path, "llvmcache-" + key + ".deps");
+        return path.str().str();
+    }
+
+    string ObjectCache::getObjPath(string const& key, size_t index) const {
+        SmallString<128> path{dir};
+        sys::path::append(path, "llvmcache-" + key + "." + to_string(index) + ".o");
+        return path.str().str();
+    }
+
+    string ObjectCache::getKey(string const& fileName, string const& options) const {
+        auto source = MemoryBuffer::getFile(fileName);
+        if(!source)
+            return "";
+
+        MD5 md5;
+        md5.update(compilerIdentity());
+        md5.update(AN_TARGET_TRIPLE);
+        md5.update(options);
+        md5.update(fileName);
+        md5.update((*source)->getBuffer());
+
+        MD5::MD5Result result;
+        md5.final(result);
+        return result.digest().str().str();
+    }
+
+    vector<string> ObjectCache::lookup(string const& key) const {
+        ifstream manifest{getManifestPath(key)};
+        size_t objCount = 0;
+        if(!(manifest >> objCount) || objCount == 0){
+            cacheMisses++;
+            return {};
+        }
+
+        //Each remaining line is the hash of a dependency followed by its path
+        string hash, path;
+        while(manifest >> hash && getline(manifest >> ws, path)){
+            if(hashFile(path) != hash){
+                cacheMisses++;
+                return {};
+            }
+        }
+
+        vector<string> objFiles;
+        for(size_t i = 0; i < objCount; i++){
+            objFiles.push_back(getObjPath(key, i));
+            if(!sys::fs::exists(objFiles.back())){
+                cacheMisses++;
+                return {};
+            }
+        }
+
+        cacheHits++;
+        return objFiles;
+    }
+
+    /**
+     * Write a file into the cache by first creating it under a unique temporary
+     * name and then renaming it, so that concurrent compilations never see a
+     * partially written entry.
+     */
+    template<typename F>
+    bool writeAtomically(string const& dir, string const& dest, F write){
+        SmallString<128> model{dir};
+        sys::path::append(model, "llvmcache-tmp-%%%%%%%%");
+        SmallString<128> tmp;
+        int fd;
+        if(sys::fs::createUniqueFile(model, fd, tmp))
+            return false;
+
+        bool written;
+        {
+            raw_fd_ostream os{fd, /*shouldClose*/true};
+            written = write(os, tmp);
+        }
+
+        if(!written || sys::fs::rename(tmp, dest)){
+            sys::fs::remove(tmp);
+            return false;
+        }
+        return true;
+    }
+
+    bool writeCacheEntry(string const& dir, string const& dest, StringRef contents){
+        if(sys::fs::create_directories(dir))
+            return false;
+
+        return writeAtomically(dir, dest, [&](raw_fd_ostream &os, StringRef){
+            os << contents;
+            return true;
+        });
+    }
+
+    void ObjectCache::store(string const& key, vector<string> const& objFiles,
+            vector<const string*> const& dependencies) const {
+
+        if(sys::fs::create_directories(dir))
+            return;
+
+        for(size_t i = 0; i < objFiles.size(); i++){
+            bool stored = writeAtomically(dir, getObjPath(key, i), [&](raw_fd_ostream &os, StringRef tmp){
+                os.close();
+                return !sys::fs::copy_file(objFiles[i], tmp);
+            });
+            if(!stored) return;
+        }
+
+        string manifest = to_string(objFiles.size()) + "\n";
+        for(auto *dependency : dependencies){
+            string hash = hashFile(*dependency);
+            if(hash.empty()) return;
+            manifest += hash + " " + *dependency + "\n";
+        }
+
+        //The manifest is written last so an entry is never used before all of its objects are stored
+        writeAtomically(dir, getManifestPath(key), [&](raw_fd_ostream &os, StringRef){
+            os << manifest;
+            return true;
+        });
+
+        CachePruningPolicy policy;
+        policy.Interval = std::chrono::seconds(0);
+        policy.MaxSizeBytes = maxSizeBytes;
+        pruneCache(dir, policy);
+    }
+
+    void ObjectCache::purge(string const& dir){
+        std::error_code ec;
+        for(sys::fs::directory_iterator it{dir, ec}, end; it != end && !ec; it.increment(ec)){
+            if(sys::path::filename(it->path()).startswith("llvmcache-"))
+                sys::fs::remove(it->path());
+        }
+    }
+
+    void ObjectCache::printStatistics(){
+        if(cacheHits + cacheMisses == 0)
+            return;
+
+        cout << "Object cache:\n";
+        cout << "    Hits:   " << cacheHits << '\n';
+        cout << "    Misses: " << cacheMisses << '\n';
+    }
+}
@@ -1,10 +1,12 @@
-#include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
 #include "unification.h"
 #include "scopeguard.h"
 #include "antevalue.h"
 #include "compiler.h"
 #include "function.h"
+#include "interpreter.h"
 #include "compapi.h"
 #include "target.h"
 #include "tokens.h"
@@ -329,25 +331,63 @@ Declaration* findFnInImpl(string const& fnName, TraitImpl *impl){
     ASSERT_UNREACHABLE();
 }
 
+AnFunctionType* applyMonomorphisationBindings(Compiler *c, AnFunctionType *type){
+    return static_cast<AnFunctionType*>(c->compCtxt->monomorphisationBindings.apply(type));
+}
+
 TypedValue monomorphise(Compiler *c, FuncDecl *fd, AnFunctionType *boundType, LOC_TY &loc){
     auto fnTy = try_cast<AnFunctionType>(fd->definition->getType());
 
     //To be monomorphised, the function must be both generic and a definition, ie external
     //decls like printf: (ref c8) ... -> i32  are generic but cannot be monomorphised.
     auto isGenericDef = fnTy->isGeneric && static_cast<FuncDeclNode*>(fd->definition)->child;
-    if(isGenericDef){
-        TypeError err{"Error in monomorphisation of " + fd->name + ", types are "
-            + anTypeToColoredStr(fnTy) + " bound to " + anTypeToColoredStr(boundType), loc};
-        auto subs = unify({{fnTy, boundType, err}});
-        c->compCtxt->insertMonomorphisationMappings(subs);
-    }
-    auto ret = c->compFn(fd);
-    fd->tval.val = isGenericDef ? nullptr : ret.val;
-    return ret;
-}
+    if(!isGenericDef){
+        auto ret = c->compFn(fd);
+        fd->tval.val = ret.val;
+        return ret;
+    }
+
+    //Only fully concrete instances can be reused, anything still generic
+    //depends on the bindings of the function currently being compiled.
+    auto *concreteType = boundType->isGeneric
+        ? applyMonomorphisationBindings(c, boundType)
+        : boundType;
+
+    //Trait constraints are left out of the key since each TraitImpl in them is
+    //allocated anew whenever a type is resolved.  They are still fully
+    //determined by a concrete signature.
+    auto *signature = AnFunctionType::get(concreteType->retTy, concreteType->paramTys, {});
+    auto key = std::make_pair(fd, (AnType*)signature);
+    if(!concreteType->isGeneric){
+        auto it = c->compCtxt->instances.find(key);
+        if(it != c->compCtxt->instances.end()){
+            c->compCtxt->instancesReused++;
+            return it->second;
+        }
+    }
 
-AnFunctionType* applyMonomorphisationBindings(AnFunctionType *type, Substitutions const& bindings){
-    return static_cast<AnFunctionType*>(ante::applySubstitutions(bindings, type));
+    TypeError err{"Error in monomorphisation of " + fd->name + ", types are "
+        + anTypeToColoredStr(fnTy) + " bound to " + anTypeToColoredStr(boundType), loc};
+    auto subs = unify({{fnTy, boundType, err}});
+
+    auto &bindings = c->compCtxt->monomorphisationBindings;
+    bindings.push();
+    bindings.bind(subs);
+
+    TypedValue ret;
+    try{
+        ret = c->compFn(fd);
+    }catch(CtError const& e){
+        bindings.pop();
+        throw e;
+    }
+    bindings.pop();
+    fd->tval.val = nullptr;
+    c->compCtxt->instancesCompiled++;
+
+    if(ret.val && !concreteType->isGeneric)
+        c->compCtxt->instances[key] = ret;
+    return ret;
 }
 
 TypedValue compForLoopTraitFn(Compiler *c, string const& fnName, TraitImpl *impl, AnType *argTy, LOC_TY &loc){
@@ -361,9 +401,9 @@ TypedValue compForLoopTraitFn(Compiler *c, string const& fnName, TraitImpl *impl
 
     auto subs = unify({{fnTy, boundTy, err}});
 
-    c->compCtxt->insertMonomorphisationMappings(subs);
+    c->compCtxt->monomorphisationBindings.bind(subs);
 
-    fnTy = applyMonomorphisationBindings(fnTy, c->compCtxt->monomorphisationMappings);
+    fnTy = applyMonomorphisationBindings(c, fnTy);
     return monomorphise(c, fn, fnTy, loc);
 }
 
@@ -621,7 +661,7 @@ TypedValue getFunction(Compiler *c, BinOpNode *bop){
         return decl->tval;
     }else if(decl->isTraitFuncDecl()){
         auto fnTy = try_cast<AnFunctionType>(bop->lval->getType());
-        fnTy = applyMonomorphisationBindings(fnTy, c->compCtxt->monomorphisationMappings);
+        fnTy = applyMonomorphisationBindings(c, fnTy);
         if(TypedValue f = findBuiltinFn(c, bop->op, fnTy)){
             return f;
         }
@@ -751,16 +791,12 @@ void* lookupCFn(string name){
 TypedValue createMallocAndStore(Compiler *c, TypedValue &val){
     array<Type*, 1> args{Type::getIntNTy(*c->ctxt, AN_USZ_SIZE)};
     auto *mallocTy = FunctionType::get(Type::getIntNPtrTy(*c->ctxt, 8), args, false);
-    Function* mallocFn = Function::Create(mallocTy, Function::ExternalLinkage, "malloc");
-
-    auto size_result = val.type->getSizeInBits(c);
-    if(!size_result){
-        cerr << size_result.getErr() << endl;
-        size_result = 0;
-    }
-    auto size = size_result.getVal() / 8;
+    Function* mallocFn = c->module->getFunction("malloc");
+    if(!mallocFn)
+        mallocFn = Function::Create(mallocTy, Function::ExternalLinkage, "malloc", c->module.get());
 
-    Value *sizeVal = ConstantInt::get(*c->ctxt, APInt(AN_USZ_SIZE, size, true));
+    //sizeof the llvm type includes any padding the store below writes
+    auto *sizeVal = ConstantExpr::getTruncOrBitCast(ConstantExpr::getSizeOf(val.getType()), args[0]);
 
     Value *voidPtr = c->builder.CreateCall(mallocFn, sizeVal);
     Type *ptrTy = val.getType()->getPointerTo();
@@ -778,24 +814,26 @@ TypedValue createMallocAndStore(Compiler *c, TypedValue &val){
  * Unwrap the single i8* argument given to AnteCall into a vector of each value the
  * function it should call requires.
  */
-vector<Value*> unwrapVoidPtrArgs(Compiler *c, Value *anteCallArg, vector<TypedValue> const& typedArgs, FuncDecl *fd){
+vector<Value*> unwrapVoidPtrArgs(Compiler *c, Value *anteCallArg, vector<TypedValue> const& typedArgs, Function *f){
     vector<Value*> ret;
-    bool varargs = cast<Function>(fd->tval.val)->isVarArg();
+    bool varargs = f->isVarArg();
 
-    auto *fnTy = cast<Function>(fd->tval.val)->getFunctionType();
+    auto *fnTy = f->getFunctionType();
     if(fnTy->getNumParams() == 0 && !varargs) return ret;
 
+    //The arguments are the fields of a struct so that each is aligned,
+    //matching how AnteValue lays them out
     size_t argc = fnTy->getNumParams();
+    vector<llvm::Type*> argTys;
     for(size_t i = 0; i < argc or (varargs && i < typedArgs.size()); i++){
-        llvm::Type *castTy = varargs ?
-            typedArgs[i].getType()->getPointerTo() :
-            fnTy->getParamType(i)->getPointerTo();
-
-        Value *cast = c->builder.CreateBitCast(anteCallArg, castTy);
-        ret.push_back(c->builder.CreateLoad(cast));
+        argTys.push_back(varargs ? typedArgs[i].getType() : fnTy->getParamType(i));
+    }
 
-        if(i != argc - 1 or (varargs && i != typedArgs.size() - 1))
-            anteCallArg = c->builder.CreateInBoundsGEP(cast, c->builder.getInt64(1));
+    auto *argsTy = StructType::get(*c->ctxt, argTys);
+    Value *args = c->builder.CreateBitCast(anteCallArg, argsTy->getPointerTo());
+    for(unsigned i = 0; i < argTys.size(); i++){
+        Value *arg = c->builder.CreateStructGEP(argsTy, args, i);
+        ret.push_back(c->builder.CreateLoad(arg));
     }
 
     return ret;
@@ -804,30 +842,30 @@ vector<Value*> unwrapVoidPtrArgs(Compiler *c, Value *anteCallArg, vector<TypedVa
 
 /**
  * Creates a function AnteCall that unpacks the given arguments from a void*,
- * and returns the result of a call to the given FuncDecl with those arguments.
+ * and returns the result of a call to the given function with those arguments.
  *
- * AnteCall has the type 't*->'u* where 't is a tuple of fd's parameter types (to
- * be unpacked within AnteCall) and 'u is the return type of fd.
+ * AnteCall has the type 't*->'u* where 't is a tuple of fn's parameter types (to
+ * be unpacked within AnteCall) and 'u is the return type of fn.
  */
-void createDriverFunction(Compiler *c, FuncDecl *fd, vector<TypedValue> const& typedArgs){
+void createDriverFunction(Compiler *c, TypedValue const& fn, vector<TypedValue> const& typedArgs){
     Type *voidPtrTy = Type::getInt8Ty(*c->ctxt)->getPointerTo();
     FunctionType *fnTy = FunctionType::get(voidPtrTy, voidPtrTy, false);
 
     //preFn is the predecessor to fn because we do not yet know its return type, so its body must be compiled,
     //then the type must be checked and the new function with correct return type created, and their bodies swapped.
-    Function *fn = Function::Create(fnTy, Function::ExternalLinkage, "AnteCall", c->module.get());
-    BasicBlock *entry = BasicBlock::Create(*c->ctxt, "entry", fn);
+    Function *driver = Function::Create(fnTy, Function::ExternalLinkage, "AnteCall", c->module.get());
+    BasicBlock *entry = BasicBlock::Create(*c->ctxt, "entry", driver);
     c->builder.SetInsertPoint(entry);
 
-    auto *fnArg1 = fn->arg_begin();
-    auto args = unwrapVoidPtrArgs(c, fnArg1, typedArgs, fd);
+    auto *fnArg1 = driver->arg_begin();
+    auto args = unwrapVoidPtrArgs(c, fnArg1, typedArgs, cast<Function>(fn.val));
 
-    Value *call = c->builder.CreateCall(fd->tval.val, args);
-    AnType *retTy = fd->tval.type->getFunctionReturnType();
+    Value *call = c->builder.CreateCall(fn.val, args);
+    AnType *retTy = fn.type->getFunctionReturnType();
     if(retTy->typeTag == TT_Unit){
         c->builder.CreateRetVoid();
     }else{
-        auto callTv = TypedValue(call, fd->tval.type->getFunctionReturnType());
+        auto callTv = TypedValue(call, retTy);
 
         auto store = createMallocAndStore(c, callTv);
         auto ret = c->builder.CreateBitCast(store.val, voidPtrTy);
@@ -909,7 +947,7 @@ void insertDependencies(CompilingVisitor &cv, Function *f,
 
         TypedValue result;
         if(type->hasModifier(Tok_Mut)){
-            Value *alloca = c->builder.CreateAlloca(val.getType(), nullptr, name);
+            Value *alloca = c->compCtxt->stackSlots->create(c->builder, val.getType(), name);
             val.val = c->builder.CreateStore(val.val, alloca);
             result = {alloca, type};
         }else{
@@ -931,7 +969,17 @@ pair<Function*, AnType*> compileShellFunction(CompilingVisitor &cv, Function *f,
     BasicBlock *oldBlock = cv.c->builder.GetInsertBlock();
     cv.c->builder.SetInsertPoint(&f->getBasicBlockList().back());
 
-    expr->accept(cv);
+    //Like compFn, the shell must not reuse the slots of the function it is within
+    auto &stackSlots = cv.c->compCtxt->stackSlots;
+    auto *enclosingSlots = stackSlots.release();
+    stackSlots = llvm::make_unique<StackSlots>();
+    try{
+        expr->accept(cv);
+    }catch(CtError const& e){
+        stackSlots.reset(enclosingSlots);
+        throw e;
+    }
+    stackSlots.reset(enclosingSlots);
 
     // error in repl, caught by RootNode but must be handled again
     if(!cv.val.val){
@@ -955,11 +1003,161 @@ pair<Function*, AnType*> compileShellFunction(CompilingVisitor &cv, Function *f,
 }
 
 
-TypedValue callAnteFunction(Compiler *c, Function *main, BasicBlock *originalInsertPoint,
+/** Strip any GEPs and casts from ptr to find the object it points into */
+Value* getBasePointer(Value *ptr){
+    while(true){
+        if(auto *gep = dyn_cast<GEPOperator>(ptr))
+            ptr = gep->getPointerOperand();
+        else if(auto *cast = dyn_cast<BitCastOperator>(ptr))
+            ptr = cast->getOperand(0);
+        else
+            return ptr;
+    }
+}
+
+bool isStackSlot(Value *ptr){
+    return isa<AllocaInst>(getBasePointer(ptr));
+}
+
+bool isConstantGlobal(Value *ptr){
+    auto *global = dyn_cast<GlobalVariable>(getBasePointer(ptr));
+    return global && global->isConstant();
+}
+
+bool CtfeCache::isPure(FuncDecl *fd){
+    if(fd->isPure)
+        return true;
+
+    auto *f = dyn_cast_or_null<Function>(fd->tval.val);
+    return f && isPure(f);
+}
+
+bool CtfeCache::isPure(Function *f){
+    auto it = purity.find(f);
+    if(it != purity.end())
+        return it->second;
+
+    if(f->isDeclaration())
+        return false;
+
+    //Recursive calls are assumed pure until the rest of f is checked
+    purity[f] = true;
+
+    auto isPureInst = [&](Instruction &inst){
+        if(auto *store = dyn_cast<StoreInst>(&inst))
+            return isStackSlot(store->getPointerOperand());
+
+        if(auto *load = dyn_cast<LoadInst>(&inst))
+            return isStackSlot(load->getPointerOperand()) || isConstantGlobal(load->getPointerOperand());
+
+        if(auto *intrinsic = dyn_cast<IntrinsicInst>(&inst)){
+            auto id = intrinsic->getIntrinsicID();
+            if(id == Intrinsic::lifetime_start || id == Intrinsic::lifetime_end || isa<DbgInfoIntrinsic>(intrinsic))
+                return true;
+        }
+
+        if(auto *mem = dyn_cast<MemTransferInst>(&inst))
+            return isStackSlot(mem->getRawDest())
+                && (isStackSlot(mem->getRawSource()) || isConstantGlobal(mem->getRawSource()));
+
+        if(auto *mem = dyn_cast<MemSetInst>(&inst))
+            return isStackSlot(mem->getRawDest());
+
+        if(auto *call = dyn_cast<CallInst>(&inst)){
+            Function *callee = call->getCalledFunction();
+            if(!callee)
+                return false;
+            if(callee->isIntrinsic())
+                return callee->doesNotAccessMemory();
+            return !callee->isDeclaration() && isPure(callee);
+        }
+
+        return !inst.mayReadOrWriteMemory();
+    };
+
+    for(auto &block : *f){
+        for(auto &inst : block){
+            if(!isPureInst(inst)){
+                //Anything checked while f was assumed pure must be checked again
+                vector<Function*> assumed;
+                for(auto &entry : purity)
+                    if(entry.second)
+                        assumed.push_back(entry.first);
+                for(auto *fn : assumed)
+                    purity.erase(fn);
+
+                purity[f] = false;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const string* CtfeCache::lookup(FuncDecl *fd, vector<AnType*> const& argTys, string const& args){
+    auto it = results.find(Key{fd, argTys, args});
+    if(it == results.end()){
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    return &it->second;
+}
+
+void CtfeCache::store(FuncDecl *fd, vector<AnType*> const& argTys, string const& args, string const& result){
+    results[Key{fd, argTys, args}] = result;
+}
+
+
+/** True if a value of the given type is marshalled with an address in it */
+bool containsPointer(Type *type){
+    if(type->isPointerTy())
+        return true;
+
+    for(auto *elem : type->subtypes())
+        if(containsPointer(elem))
+            return true;
+    return false;
+}
+
+
+/**
+ * Add any new definitions in the current module to the Compiler's JIT session
+ * and call the given driver function created by createDriverFunction.
+ *
+ * If fd is given and is pure, its result is memoized for the rest of the
+ * session and a later call with the same arguments returns it without
+ * running fd again.  Calls with an argument containing a pointer are never
+ * memoized since equal addresses may point to different data.
+ */
+TypedValue callAnteFunction(Compiler *c, Function *driver,
         vector<TypedValue> const& typedArgs, vector<unique_ptr<Node>> const& argExprs,
-        unique_ptr<orc::LLLazyJIT> &jit, AnType *retTy){
+        AnType *retTy, FuncDecl *fd){
+
+    AnteValue arg;
+    if(!typedArgs.empty())
+        arg = AnteValue(c, typedArgs, argExprs);
+
+    CtfeCache &cache = c->ctCtxt->ctfeCache;
+    bool memoize = fd && cache.isPure(fd) && std::none_of(typedArgs.begin(), typedArgs.end(),
+        [&](TypedValue const& tv){ return containsPointer(c->anTypeToLlvmType(tv.type)); });
+
+    vector<AnType*> argTys;
+    string argBytes;
+    if(memoize){
+        size_t size = 0;
+        for(auto &tv : typedArgs){
+            argTys.push_back(tv.type);
+            size += getMarshalledSize(c, tv.type);
+        }
+        if(size)
+            argBytes.assign((char*)arg.asRawData(), size);
+
+        if(auto *result = cache.lookup(fd, argTys, argBytes))
+            return AnteValue((void*)result->data(), retTy).asTypedValue(c);
+    }
 
-    auto symbol = jit->lookup("AnteCall").get().getAddress();
+    auto symbol = c->jit->addModuleAndLookup(*c->module, driver);
 
     if(symbol){
         void *res;
@@ -968,9 +1166,13 @@ TypedValue callAnteFunction(Compiler *c, Function *main, BasicBlock *originalIns
             res = fn();
         }else{
             auto fn = (void*(*)(void*))symbol;
-            auto arg = AnteValue(c, typedArgs, argExprs);
             res = fn(arg.asRawData());
         }
+
+        if(memoize){
+            size_t size = getMarshalledSize(c, retTy);
+            cache.store(fd, argTys, argBytes, size ? string((char*)res, size) : "");
+        }
         return AnteValue(res, retTy).asTypedValue(c);
     }else{
         LOC_TY loc;
@@ -1014,18 +1216,9 @@ FuncDecl* compileAnteFunction(Compiler *c, string const& baseName, string const&
 TypedValue compileAndCallAnteFunction(Compiler *c, ModNode *n){
     CompilingVisitor cv{c};
 
-    //and will crash llvm if we try to clone it without a ReturnInst
-    auto mainFnName = "main";
-    auto main = c->module->getFunction(mainFnName);
-    if(main){
-        main->removeFromParent();
-    }
-
     auto originalInsertPoint = c->builder.GetInsertBlock();
 
     auto cleanup = [&]{
-        if(main)
-            c->module->getFunctionList().push_front(main);
         if(auto f1 = c->module->getFunction("AnteCall")) f1->eraseFromParent();
         if(auto f2 = c->module->getFunction("EmptyShell")) f2->eraseFromParent();
         c->builder.SetInsertPoint(originalInsertPoint);
@@ -1033,64 +1226,38 @@ TypedValue compileAndCallAnteFunction(Compiler *c, ModNode *n){
 
     //compile ante function and a driver to run it
     auto shellAndType = compileAnonAnteFunction(cv, n, cleanup);
-    auto shellName = shellAndType.first->getName();
+    auto shell = shellAndType.first;
 
-    createDriverFunction(c, shellAndType.first, shellAndType.second);
+    createDriverFunction(c, shell, shellAndType.second);
+    auto driver = c->module->getFunction("AnteCall");
 
-    auto clone = llvm::CloneModule(*c->module.get());
-    auto tsm = orc::ThreadSafeModule(move(clone), std::unique_ptr<LLVMContext>(c->ctxt.get()));
-
-    auto triple = Triple(AN_NATIVE_ARCH, AN_NATIVE_VENDOR, AN_NATIVE_OS);
-    DataLayout dl{clone.get()};
-    orc::JITTargetMachineBuilder b{triple};
-
-    auto &jit = orc::LLLazyJIT::Create(b, dl).get();
-
-    jit->addLazyIRModule(move(tsm)).success();
+    //the unfinished main function is left out of the JIT automatically
+    auto ret = callAnteFunction(c, driver, {}, {}, shellAndType.second, nullptr);
 
     cleanup();
-    c->module->getFunction(shellName)->removeFromParent();
-    return callAnteFunction(c, main, originalInsertPoint, {}, {}, jit, shellAndType.second);
+    shell->eraseFromParent();
+    return ret;
 }
 
 TypedValue compileAndCallAnteFunction(Compiler *c, string const& baseName,
         string const& mangledName, vector<TypedValue> const& typedArgs,
         vector<unique_ptr<Node>> const& argExprs){
 
-    //temporarily remove main function since it is unfinished
-    //and will crash llvm if we try to clone it without a ReturnInst
-    auto mainFnName = "main";
-    auto main = c->module->getFunction(mainFnName);
-    if(main){
-        main->removeFromParent();
-    }
-
     auto originalInsertPoint = c->builder.GetInsertBlock();
 
     //compile ante function and a driver to run it
     FuncDecl *fd = compileAnteFunction(c, baseName, mangledName, typedArgs);
 
-    createDriverFunction(c, fd, typedArgs);
+    createDriverFunction(c, fd->tval, typedArgs);
     auto *retTy = fd->tval.type->getFunctionReturnType();
+    auto driver = c->module->getFunction("AnteCall");
 
-    auto clone = llvm::CloneModule(*c->module);
-    auto tsm = orc::ThreadSafeModule(move(clone), std::unique_ptr<LLVMContext>(c->ctxt.get()));
-
-    auto triple = Triple(AN_NATIVE_ARCH, AN_NATIVE_VENDOR, AN_NATIVE_OS);
-    DataLayout dl{clone.get()};
-    orc::JITTargetMachineBuilder b{triple};
-
-    auto &jit = orc::LLLazyJIT::Create(b, dl).get();
-
-    jit->addLazyIRModule(move(tsm)).success();
+    //the unfinished main function is left out of the JIT automatically
+    auto ret = callAnteFunction(c, driver, typedArgs, argExprs, retTy, fd);
 
-    if(main){
-        c->module->getFunctionList().push_front(main);
-    }
-
-    c->module->getFunction("AnteCall")->eraseFromParent();
+    driver->eraseFromParent();
     c->builder.SetInsertPoint(originalInsertPoint);
-    return callAnteFunction(c, main, originalInsertPoint, typedArgs, argExprs, jit, retTy);
+    return ret;
 }
 */
 
@@ -1157,6 +1324,10 @@ bool isUnsizedType(Type *t){
 TypedValue addrOf(Compiler *c, TypedValue &tv){
     auto *ptrTy = AnPtrType::get(tv.type);
 
+    //the address may outlive the block of the variable it points to
+    if(auto *slot = getLoadedSlot(tv.val))
+        c->compCtxt->stackSlots->escape(slot);
+
     if(LoadInst* li = dyn_cast<LoadInst>(tv.val)){
         return TypedValue(li->getPointerOperand(), ptrTy);
     }else if(ExtractValueInst *evi = dyn_cast<ExtractValueInst>(tv.val)){
@@ -1168,12 +1339,60 @@ TypedValue addrOf(Compiler *c, TypedValue &tv){
         }
     }
     //if it is not stack-allocated already, allocate it on the stack
-    auto *alloca = c->builder.CreateAlloca(tv.getType());
+    auto *alloca = c->compCtxt->stackSlots->create(c->builder, tv.getType());
     c->builder.CreateStore(tv.val, alloca);
     return TypedValue(alloca, ptrTy);
 }
 
 
+bool isCtConstantGlobal(Compiler *c, Value *v){
+    auto *global = dyn_cast_or_null<GlobalVariable>(v);
+    return global && global->hasInitializer()
+        && c->compCtxt->constantGlobals.lookup(global->getInitializer()) == global;
+}
+
+
+TypedValue getCtConstantGlobal(Compiler *c, TypedValue const& tv){
+    if(auto *load = dyn_cast<LoadInst>(tv.val)){
+        if(isCtConstantGlobal(c, load->getPointerOperand()))
+            return {load->getPointerOperand(), tv.type};
+    }
+
+    auto *val = dyn_cast<Constant>(tv.val);
+    if(!val || c->isJIT || !(isa<ConstantAggregate>(val) || isa<ConstantDataSequential>(val)))
+        return tv;
+
+    auto &global = c->compCtxt->constantGlobals[val];
+    if(!global){
+        global = new GlobalVariable(*c->module, val->getType(), true,
+                GlobalValue::PrivateLinkage, val, "ctconst");
+        global->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    }
+    return {global, tv.type};
+}
+
+
+TypedValue loadCtConstant(Compiler *c, TypedValue const& tv){
+    if(!c->builder.GetInsertBlock())
+        return tv;
+
+    auto global = getCtConstantGlobal(c, tv);
+    if(global.val == tv.val)
+        return tv;
+    return {c->builder.CreateLoad(global.val), tv.type};
+}
+
+
+Constant* getCtConstant(Compiler *c, Value *v){
+    if(auto *load = dyn_cast<LoadInst>(v))
+        v = load->getPointerOperand();
+
+    if(isCtConstantGlobal(c, v))
+        return cast<GlobalVariable>(v)->getInitializer();
+    return dyn_cast<Constant>(v);
+}
+
+
 Value* Compiler::tupleOf(vector<Value*> const& elems, bool packed){
     vector<int> nonConstIndices;
     auto constVals = vecOf<Constant*>(elems.size());
@@ -1212,12 +1431,12 @@ vector<Value*> adaptArgsToCompilerAPIFn(Compiler *c, vector<Value*> &args, vecto
 
     int i = 0;
     for(auto *val : args){
-        auto valref = c->builder.CreateAlloca(val->getType());
+        auto valref = c->compCtxt->stackSlots->create(c->builder, val->getType());
         c->builder.CreateStore(val, valref);
         auto valTy = c->ptrTo(typedArgs[i++].type);
 
         auto arg = c->tupleOf({valref, valTy}, true);
-        auto argref = c->builder.CreateAlloca(arg->getType());
+        auto argref = c->compCtxt->stackSlots->create(c->builder, arg->getType());
         c->builder.CreateStore(arg, argref);
         ret.push_back(argref);
     }
@@ -1237,6 +1456,67 @@ TypedValue handleAnteFn(Compiler *c, BinOpNode *bop, vector<TypedValue> &typedAr
 }
 
 
+/**
+ * Evaluate a call to the ante function fd during compile-time.
+ *
+ * Calls are first given to the interpreter.  Those it cannot handle are
+ * compiled and run in the JIT instead.  Once run, the body of the ante
+ * function is removed again so that it is never emitted into the binary,
+ * later JIT calls to it are resolved by name.
+ */
+TypedValue compCompileTimeCall(Compiler *c, BinOpNode *bop, FuncDecl *fd,
+        vector<TypedValue> const& typedArgs, vector<unique_ptr<Node>> const& argExprs){
+
+    vector<TypedValue> args;
+    for(auto &arg : typedArgs){
+        if(isEmptyType(c, arg.type))
+            continue;
+
+        //results of other compile-time calls are passed as the constants they were loaded from
+        auto *val = getCtConstant(c, arg.val);
+        args.emplace_back(val ? val : arg.val, arg.type);
+    }
+
+    if(!fd->getFDN()->child)
+        return InterpretingVisitor::callCompilerApi(c, fd, args, bop->loc);
+
+    if(auto ret = InterpretingVisitor::tryInterpret(c, fd, args))
+        return ret;
+
+    auto originalInsertPoint = c->builder.GetInsertBlock();
+    TypedValue fn;
+    {
+        TMP_SET(c->isJIT, true);
+        fn = getFunction(c, bop);
+    }
+    c->builder.SetInsertPoint(originalInsertPoint);
+    if(!fn)
+        error("Unknown error when attempting to call function", bop->loc);
+
+    createDriverFunction(c, fn, args);
+    auto *retTy = fn.type->getFunctionReturnType();
+    auto driver = c->module->getFunction("AnteCall");
+
+    TypedValue ret;
+    try{
+        ret = callAnteFunction(c, driver, args, argExprs, retTy, fd);
+    }catch(...){
+        driver->eraseFromParent();
+        c->builder.SetInsertPoint(originalInsertPoint);
+        throw;
+    }
+    c->ctCtxt->callsJitted++;
+
+    driver->eraseFromParent();
+    c->builder.SetInsertPoint(originalInsertPoint);
+
+    auto *f = cast<Function>(fn.val);
+    if(!f->isDeclaration())
+        f->deleteBody();
+    return ret;
+}
+
+
 TypedValue compFnCall(Compiler *c, BinOpNode *bop){
     //used to type-check each parameter later
     vector<TypedValue> typedArgs;
@@ -1277,6 +1557,28 @@ TypedValue compFnCall(Compiler *c, BinOpNode *bop){
     auto ctval = handleAnteFn(c, bop, typedArgs);
     if(ctval) return ctval;
 
+    auto *fdn = bop->decl->isFuncDecl() ? static_cast<FuncDecl*>(bop->decl)->getFDN() : nullptr;
+    if(c->isJIT && fdn && !fdn->child && fdn->hasModifier(Tok_Ante) && capi::lookup(bop->decl->name))
+        error("Compiler API functions cannot be called from compile-time code which is JIT-compiled", bop->loc);
+
+    if(!c->isJIT && fdn && fdn->hasModifier(Tok_Ante)){
+        auto *fd = static_cast<FuncDecl*>(bop->decl);
+        if(auto *tup = dynamic_cast<TupleNode*>(r))
+            return loadCtConstant(c, compCompileTimeCall(c, bop, fd, typedArgs, tup->exprs));
+
+        vector<unique_ptr<Node>> argExprs;
+        argExprs.emplace_back(r);
+        auto releaseArg = [&]{ argExprs[0].release(); };
+        try{
+            auto ret = compCompileTimeCall(c, bop, fd, typedArgs, argExprs);
+            releaseArg();
+            return loadCtConstant(c, ret);
+        }catch(...){
+            releaseArg();
+            throw;
+        }
+    }
+
     //try to compile the function now that the parameters are compiled.
     TypedValue tvf = getFunction(c, bop);
 
@@ -1589,9 +1891,9 @@ void CompilingVisitor::visit(BinOpNode *n){
                 + " bound to " + anTypeToColoredStr(boundTy), n->loc};
             auto subs = unify({{fnTy, boundTy, err}});
 
-            c->compCtxt->insertMonomorphisationMappings(subs);
+            c->compCtxt->monomorphisationBindings.bind(subs);
 
-            fnTy = applyMonomorphisationBindings(fnTy, c->compCtxt->monomorphisationMappings);
+            fnTy = applyMonomorphisationBindings(c, fnTy);
             if(TypedValue f = findBuiltinFn(c, n->op, fnTy)){
                 array<Value*, 2> args{lhs.val, rhs.val};
                 Value *call = c->builder.CreateCall(f.val, args);
@@ -1,6 +1,7 @@
 #include "pattern.h"
 #include "types.h"
 #include "util.h"
+#include <llvm/IR/CFG.h>
 
 using namespace std;
 using namespace llvm;
@@ -110,6 +111,46 @@ namespace ante {
         }
     }
 
+    /**
+     * Return the tag of a union value.  All tagged unions are either
+     * just their tag (enum) or a tag followed by their variant's fields.
+     */
+    Value* getUnionTag(Compiler *c, TypedValue &valToMatch){
+        if(valToMatch.getType()->isStructTy()){
+            return c->builder.CreateExtractValue(valToMatch.val, 0);
+        }else if(valToMatch.getType()->isIntegerTy()){
+            return valToMatch.val;
+        }else{
+            ASSERT_UNREACHABLE("Unknown sum-type in getUnionTag");
+        }
+    }
+
+    /**
+     * Bind the fields of a union variant to bindExpr, matching any
+     * nested patterns within.  Assumes the tag has already been checked.
+     */
+    void match_variant_fields(CompilingVisitor &cv, MatchNode *n, AnDataType *parentTy,
+            vector<unique_ptr<Node>> const& bindExpr, BasicBlock *jmpOnFail, TypedValue &valToMatch){
+
+        if(bindExpr.empty())
+            return;
+
+        Compiler *c = cv.c;
+        vector<TypedValue> variantArgs;
+        if(valToMatch.getType()->isStructTy()){
+            auto variantFieldTypes = parentTy->getBoundFieldTypes();
+            variantArgs = unionDowncast(c, valToMatch, variantFieldTypes);
+        }else if(valToMatch.getType()->isIntegerTy()){ //integer tag
+            variantArgs = {c->getUnitLiteral()};
+        }else{
+            //all tagged unions are either just their tag (enum) or a tag and value.
+            ASSERT_UNREACHABLE("Unknown variant in match_variant_fields");
+        }
+        for(size_t i = 0; i < bindExpr.size(); ++i){
+            handlePattern(cv, n, bindExpr[i].get(), jmpOnFail, variantArgs[i]);
+        }
+    }
+
     /**
      * Match a union variant pattern, eg. Some x or None
      * @param pattern The type to match against, eg. Some
@@ -123,41 +164,19 @@ namespace ante {
         // TODO: Fix with new type information
         auto *parentTy = static_cast<AnDataType*>(pattern->getType()); //wrong
 
-        ConstantInt *ci = ConstantInt::get(*c->ctxt,
-                APInt(8, parentTy->decl->getTagIndex(pattern->typeName), true));
-
         //Extract tag value and check for equality
-        Value *eq;
-        if(valToMatch.getType()->isStructTy()){
-            Value *tagVal = c->builder.CreateExtractValue(valToMatch.val, 0);
-            eq = c->builder.CreateICmpEQ(tagVal, ci);
-        }else if(valToMatch.getType()->isIntegerTy()){
-            eq = c->builder.CreateICmpEQ(valToMatch.val, ci);
-        }else{
-            //all tagged unions are either just their tag (enum) or a tag and value.
-            ASSERT_UNREACHABLE("Unknown sum-type in match_variant");
-        }
+        size_t variantIndex = parentTy->decl->getTagIndex(pattern->typeName);
+        Value *tagVal = getUnionTag(c, valToMatch);
+        ConstantInt *ci = ConstantInt::get(cast<IntegerType>(tagVal->getType()), variantIndex);
+
+        Value *eq = c->builder.CreateICmpEQ(tagVal, ci);
 
         BasicBlock *jmpOnSuccess = BasicBlock::Create(*cv.c->ctxt, "match", getCurFunction(cv.c));
         c->builder.CreateCondBr(eq, jmpOnSuccess, jmpOnFail);
         c->builder.SetInsertPoint(jmpOnSuccess);
 
         //bind any identifiers and match remaining pattern
-        if(!bindExpr.empty()){
-            vector<TypedValue> variantArgs;
-            if(valToMatch.getType()->isStructTy()){
-                auto variantFieldTypes = parentTy->getBoundFieldTypes();
-                variantArgs = unionDowncast(c, valToMatch, variantFieldTypes);
-            }else if(valToMatch.getType()->isIntegerTy()){ //integer tag
-                variantArgs = {c->getUnitLiteral()};
-            }else{
-                //all tagged unions are either just their tag (enum) or a tag and value.
-                ASSERT_UNREACHABLE("Unknown variant in match_variant");
-            }
-            for(size_t i = 0; i < bindExpr.size(); ++i){
-                handlePattern(cv, n, bindExpr[i].get(), jmpOnFail, variantArgs[i]);
-            }
-        }
+        match_variant_fields(cv, n, parentTy, bindExpr, jmpOnFail, valToMatch);
     }
 
     void handlePattern(CompilingVisitor &cv, MatchNode *n, Node *pattern,
@@ -190,6 +209,105 @@ namespace ante {
     }
 
 
+    /**
+     * Return the variant a top-level pattern tests for if it
+     * is a union variant pattern, eg. the Some in Some x
+     */
+    TypeNode* getVariantPattern(Node *pattern){
+        if(auto *tcn = dynamic_cast<TypeCastNode*>(pattern))
+            return tcn->typeExpr.get();
+        return dynamic_cast<TypeNode*>(pattern);
+    }
+
+    /**
+     * Return the index one past the end of the run of consecutive branches
+     * starting at begin which each match a variant of the same union.
+     */
+    size_t getVariantRunEnd(MatchNode *n, size_t begin){
+        TypeNode *first = getVariantPattern(n->branches[begin]->pattern.get());
+        if(!first)
+            return begin;
+
+        auto *decl = static_cast<AnDataType*>(first->getType())->decl;
+        size_t end = begin + 1;
+        while(end < n->branches.size()){
+            TypeNode *variant = getVariantPattern(n->branches[end]->pattern.get());
+            if(!variant || static_cast<AnDataType*>(variant->getType())->decl != decl)
+                break;
+            end++;
+        }
+        return end;
+    }
+
+    /** Compile a branch's body once its pattern has matched and jump to endmatch */
+    void compileMatchBranch(CompilingVisitor &cv, MatchBranchNode *mbn, BasicBlock *endmatch,
+            vector<pair<BasicBlock*,TypedValue>> &merges){
+
+        mbn->branch->accept(cv);
+        merges.push_back({cv.c->builder.GetInsertBlock(), cv.val});
+
+        //dont jump to after the match if the branch already returned from the function
+        if(!dyn_cast<ReturnInst>(cv.val.val))
+            cv.c->builder.CreateBr(endmatch);
+    }
+
+    /**
+     * Compile the branches in [begin, end), each of which matches a variant of
+     * the same union.  Rather than testing the tag once per branch, the tag is
+     * extracted once and a single switch jumps to the first branch for its variant.
+     * If a nested pattern of that branch fails, the next branch in the run for the
+     * same variant is tried, falling back to jmpOnFail once there are none left.
+     */
+    void match_variant_switch(CompilingVisitor &cv, MatchNode *n, size_t begin, size_t end,
+            BasicBlock *jmpOnFail, BasicBlock *endmatch, TypedValue &valToMatch,
+            vector<pair<BasicBlock*,TypedValue>> &merges){
+
+        Compiler *c = cv.c;
+        Function *f = getCurFunction(c);
+
+        Value *tagVal = getUnionTag(c, valToMatch);
+        auto *tagTy = cast<IntegerType>(tagVal->getType());
+        auto *sw = c->builder.CreateSwitch(tagVal, jmpOnFail, end - begin);
+
+        vector<BasicBlock*> blocks;
+        vector<size_t> tags;
+        blocks.reserve(end - begin);
+        tags.reserve(end - begin);
+
+        for(size_t i = begin; i < end; i++){
+            TypeNode *variant = getVariantPattern(n->branches[i]->pattern.get());
+            auto *parentTy = static_cast<AnDataType*>(variant->getType());
+            size_t tag = parentTy->decl->getTagIndex(variant->typeName);
+
+            auto *bb = BasicBlock::Create(*c->ctxt, "match", f);
+            if(!ante::in(tag, tags))
+                sw->addCase(ConstantInt::get(tagTy, tag), bb);
+
+            blocks.push_back(bb);
+            tags.push_back(tag);
+        }
+
+        for(size_t i = begin; i < end; i++){
+            auto &mbn = n->branches[i];
+
+            BasicBlock *nextWithTag = jmpOnFail;
+            for(size_t j = i + 1; j < end; j++){
+                if(tags[j - begin] == tags[i - begin]){
+                    nextWithTag = blocks[j - begin];
+                    break;
+                }
+            }
+
+            c->builder.SetInsertPoint(blocks[i - begin]);
+            if(auto *tcn = dynamic_cast<TypeCastNode*>(mbn->pattern.get())){
+                auto *parentTy = static_cast<AnDataType*>(tcn->typeExpr->getType());
+                match_variant_fields(cv, n, parentTy, tcn->args, nextWithTag, valToMatch);
+            }
+
+            compileMatchBranch(cv, mbn.get(), endmatch, merges);
+        }
+    }
+
     void CompilingVisitor::visit(MatchNode *n){
         n->expr->accept(*this);
         auto valToMatch = this->val;
@@ -197,33 +315,45 @@ namespace ante {
         Function *f = c->builder.GetInsertBlock()->getParent();
 
         vector<pair<BasicBlock*,TypedValue>> merges;
-        merges.reserve(n->branches.size());
+        merges.reserve(n->branches.size() + 1);
 
         BasicBlock *endmatch = BasicBlock::Create(*c->ctxt, "end_match", f);
-        BasicBlock *finalEndPat = nullptr;
 
-        for(auto& mbn : n->branches){
-            BasicBlock *endpat = &mbn == &n->branches.back() ?
-                endmatch : BasicBlock::Create(*c->ctxt, "end_pattern", f);
+        // Reached only if every pattern fails to match
+        BasicBlock *matchFail = BasicBlock::Create(*c->ctxt, "match_fail", f);
 
-            handlePattern(*this, n, mbn->pattern.get(), endpat, valToMatch);
-            mbn->branch->accept(*this);
-            merges.push_back({c->builder.GetInsertBlock(), this->val});
+        size_t i = 0;
+        while(i < n->branches.size()){
+            size_t runEnd = getVariantRunEnd(n, i);
+            size_t next = runEnd > i + 1 ? runEnd : i + 1;
 
-            //dont jump to after the match if the branch already returned from the function
-            if(!dyn_cast<ReturnInst>(this->val.val))
-                c->builder.CreateBr(endmatch);
+            BasicBlock *endpat = next == n->branches.size() ?
+                matchFail : BasicBlock::Create(*c->ctxt, "end_pattern", f);
+
+            if(next == runEnd){
+                match_variant_switch(*this, n, i, runEnd, endpat, endmatch, valToMatch, merges);
+            }else{
+                auto &mbn = n->branches[i];
+                handlePattern(*this, n, mbn->pattern.get(), endpat, valToMatch);
+                compileMatchBranch(*this, mbn.get(), endmatch, merges);
+            }
 
             c->builder.SetInsertPoint(endpat); //set insert point to next branch
-            finalEndPat = endpat == endmatch ? finalEndPat : endpat;
+            i = next;
         }
 
         // Cannot prove to LLVM match is exhaustive so an uninitialized value must be
         // "returned" each time from the branch where all matches fail.
-        if(finalEndPat){
-            TypedValue retOnFailAll = {UndefValue::get(this->val.getType()), val.type};
-            merges.push_back({finalEndPat, retOnFailAll});
+        if(pred_empty(matchFail)){
+            matchFail->eraseFromParent();
+        }else{
+            c->builder.CreateBr(endmatch);
+            if(!merges.empty()){
+                TypedValue retOnFailAll = {UndefValue::get(merges[0].second.getType()), merges[0].second.type};
+                merges.push_back({matchFail, retOnFailAll});
+            }
         }
+        c->builder.SetInsertPoint(endmatch);
 
         //merges can be empty if each branch has an early return
         if(merges.empty() or merges[0].second.type->typeTag == TT_Unit){
@@ -231,16 +361,13 @@ namespace ante {
             return;
         }
 
-        int i = 1;
-        auto *phi = c->builder.CreatePHI(merges[0].second.getType(), n->branches.size());
+        auto *phi = c->builder.CreatePHI(merges[0].second.getType(), merges.size());
         for(auto &pair : merges){
             //add each branch to the phi node if it does not return early
             if(!dyn_cast<ReturnInst>(pair.second.val)){
                 phi->addIncoming(pair.second.val, pair.first);
             }
-            i++;
         }
-        //phi->addIncoming(UndefValue::get(merges[0].second.getType()), matchbb);
         this->val = TypedValue(phi, merges[0].second.type);
     }
 
@@ -7,6 +7,7 @@
 #include "yyparser.h"
 #include "unification.h"
 #include "util.h"
+#include "session.h"
 #include <stack>
 
 #include <compiler.h>
@@ -16,18 +17,47 @@ using namespace ante::parser;
 
 namespace ante {
 
+    SourceLoc::SourceLoc(yy::location const& loc) :
+        file{0},
+        beginLine{(uint32_t)loc.begin.line}, beginColumn{(uint32_t)loc.begin.column},
+        endLine{(uint32_t)loc.end.line}, endColumn{(uint32_t)loc.end.column}{
+
+        if(!loc.begin.filename)
+            return;
+
+        auto &session = CompilationSession::current();
+        auto it = session.fileIds.find(loc.begin.filename);
+        if(it != session.fileIds.end()){
+            file = it->second;
+        }else{
+            session.files.push_back(loc.begin.filename);
+            file = session.files.size();
+            session.fileIds[loc.begin.filename] = file;
+        }
+    }
+
+    const std::string* SourceLoc::fileName() const {
+        auto &files = CompilationSession::current().files;
+        assert(file <= files.size() && "SourceLoc used outside of the session it was made in");
+        return file ? files[file - 1] : nullptr;
+    }
+
+    yy::location SourceLoc::expand() const {
+        auto *f = const_cast<std::string*>(fileName());
+        return parser::mkLoc(parser::mkPos(f, beginLine, beginColumn),
+                             parser::mkPos(f, endLine, endColumn));
+    }
+
     namespace parser {
 
-        //stack of relative roots, eg. a FuncDeclNode's first statement would be set as the
-        //relative root, where the last would be returned by the parser.  Relative roots are
-        //returned through getRoot() which also pops the stack.
-        stack<Node*> roots;
+        void* Node::operator new(size_t size){
+            return CompilationSession::current().nodeArena.Allocate(size, alignof(std::max_align_t));
+        }
 
         //The single true-root of the compiled file.  One RootNode per file parsed.
-        RootNode *root;
-
+        //Stored in the current CompilationSession.
         RootNode* getRootNode(){
-            return root;
+            return CompilationSession::current().parseTree;
         }
 
         AnType* VarNode::getType() const {
@@ -84,51 +114,51 @@ namespace ante {
             return pos;
         }
 
-        LOC_TY mkLoc(yy::position begin, yy::position end) {
-            LOC_TY loc;
+        yy::location mkLoc(yy::position begin, yy::position end) {
+            yy::location loc;
             loc.begin = begin;
             loc.end = end;
             return loc;
         }
 
         //initializes the root node
-        void createRoot(LOC_TY& loc){
-            root = new RootNode(loc);
+        void createRoot(LOC_TY const& loc){
+            CompilationSession::current().parseTree = new RootNode(loc);
         }
 
         void createRoot(){
-            auto loc = mkLoc(mkPos(yylexer->fileName, 0, 0),
-                             mkPos(yylexer->fileName, 0, 0));
+            auto loc = mkLoc(mkPos(getLexer()->fileName, 0, 0),
+                             mkPos(getLexer()->fileName, 0, 0));
             createRoot(loc);
         }
 
         Node* append_main(Node *n){
-            root->main.emplace_back(n);
+            getRootNode()->main.emplace_back(n);
             return n;
         }
 
         Node* append_fn(Node *n){
-            root->funcs.emplace_back(n);
+            getRootNode()->funcs.emplace_back(n);
             return n;
         }
 
         Node* append_type(Node *n){
-            root->types.emplace_back(n);
+            getRootNode()->types.emplace_back(n);
             return n;
         }
 
         Node* append_extension(Node *n){
-            root->extensions.emplace_back(n);
+            getRootNode()->extensions.emplace_back(n);
             return n;
         }
 
         Node* append_trait(Node *n){
-            root->traits.emplace_back(n);
+            getRootNode()->traits.emplace_back(n);
             return n;
         }
 
         Node* append_import(Node *n){
-            root->imports.emplace_back(n);
+            getRootNode()->imports.emplace_back(n);
             return n;
         }
 
@@ -171,16 +201,13 @@ namespace ante {
             return modifiableNode;
         }
 
-        LOC_TY copyLoc(const LOC_TY &loc){
-            return mkLoc(mkPos(loc.begin.filename, loc.begin.line, loc.begin.column),
-                        mkPos(loc.end.filename,   loc.end.line,   loc.end.column));
-        }
-
         /*
         *  Saves the root of a new block and returns it.
+        *  Relative roots are kept on a stack, eg. a FuncDeclNode's first statement would be
+        *  set as the relative root, where the last would be returned by the parser.
         */
         Node* setRoot(Node* node){
-            roots.push(node);
+            CompilationSession::current().blockRoots.push(node);
             return node;
         }
 
@@ -188,6 +215,7 @@ namespace ante {
         *  Pops and returns the root of the current block
         */
         Node* getRoot(){
+            auto &roots = CompilationSession::current().blockRoots;
             Node *ret = roots.top();
             roots.pop();
             return ret;
@@ -5,6 +5,7 @@
 #include <nameresolution.h>
 #include "typeinference.h"
 #include "typeerror.h"
+#include "scopeguard.h"
 
 #ifdef unix
 #  include <unistd.h>
@@ -269,8 +270,8 @@ namespace ante {
         }
 
         //lex through input to ensure all brackets are matched
-        LOC_TY loc;
-        auto l = Lexer(nullptr, line, 1, 1, false);
+        yy::location loc;
+        Lexer l{nullptr, line, 1, 1, false};
         while (l.next(&loc)){ /* do nothing*/ };
 
         //unmatched {
@@ -327,8 +328,8 @@ namespace ante {
 
 #if defined(unix) || defined(_WIN32)
             //use lexer for syntax highlighting
-            LOC_TY loc;
-            auto l = Lexer(nullptr, line, 1, 1, true);
+            yy::location loc;
+            Lexer l{nullptr, line, 1, 1, true};
             while (l.next(&loc)){ /* do nothing*/ };
 
             //move cursor from end of text to the current pos
@@ -348,8 +349,8 @@ namespace ante {
         }
 
 #if defined(unix) || defined(_WIN32)
-            LOC_TY loc;
-            auto l = Lexer(nullptr, line, 1, 1, true);
+            yy::location loc;
+            Lexer l{nullptr, line, 1, 1, true};
             while (l.next(&loc)){ /* do nothing*/ };
 #endif
         return line;
@@ -408,11 +409,68 @@ namespace ante {
     }
 
 
+    /**
+     * Move the value of a top-level variable into a global.  Each line is
+     * compiled into its own function so a later line cannot refer to the
+     * instructions or stack slots of the line that declared the variable.
+     */
+    void storeInGlobal(Compiler *c, Declaration *decl){
+        auto &tval = decl->tval;
+        if(!tval.val || llvm::isa<llvm::Constant>(tval.val))
+            return;
+
+        bool isMutable = tval.type->hasModifier(Tok_Mut) && llvm::isa<llvm::AllocaInst>(tval.val);
+        llvm::Value *val = isMutable ? c->builder.CreateLoad(tval.val) : tval.val;
+
+        //external so that the JIT resolves it by name from later lines
+        auto *global = new llvm::GlobalVariable(*c->module, val->getType(), false,
+                llvm::GlobalValue::ExternalLinkage, llvm::Constant::getNullValue(val->getType()),
+                "repl." + decl->name);
+
+        c->builder.CreateStore(val, global);
+        tval.val = global;
+    }
+
+
+    /**
+     * Compile the top-level expressions of a line into a fresh entry
+     * function and run it.  Only definitions that are new since the
+     * previous line are added to the compiler's JIT session, everything
+     * else is linked against by name, and nothing is written to disk.
+     */
+    void evalLine(Compiler *c, RootNode *rn){
+        auto *ft = llvm::FunctionType::get(llvm::Type::getVoidTy(*c->ctxt), false);
+        auto *f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, "repl", c->module.get());
+        c->builder.SetInsertPoint(llvm::BasicBlock::Create(*c->ctxt, "entry", f));
+
+        //The line is an ordinary program run by the JIT, not compile-time code
+        TMP_SET(c->isJIT, false);
+        try{
+            CompilingVisitor v{c};
+            for(auto &node : rn->main){
+                if(!node) continue;
+                node->accept(v);
+
+                auto *binding = dynamic_cast<VarAssignNode*>(node.get());
+                if(binding && dynamic_cast<VarNode*>(binding->ref_expr))
+                    storeInGlobal(c, static_cast<VarNode*>(binding->ref_expr)->decl);
+            }
+            c->builder.CreateRetVoid();
+            c->jitFunction(f);
+        }catch(CtError const& e){}
+
+        // The JIT keeps its own copy of the entry function and
+        // nothing else refers to it, so it need not stay in the module
+        f->eraseFromParent();
+    }
+
+
     void startRepl(Compiler *c){
         cout << "Ante REPL v0.2.0\nType 'exit' to exit.\n";
         setupTerm();
 
         auto cmd = getInputColorized();
+        llvm::StringMap<Variable*> bindings;
 
         while(cmd != "exit\n"){
             int flag;
@@ -433,10 +491,10 @@ namespace ante {
                 auto leak = expr->expr.release();
                 expr->expr.reset(root);
 
-                TypedValue val = mergeAndCompile(c, root, expr);
+                TypedValue val = mergeAndCompile(c, root, expr, bindings);
 
-                // Only print types until compile-time eval is setup again
                 if(val.type){
+                    evalLine(c, root);
                     sanitize(val.type)->dump();
                 }
             }
@@ -451,15 +509,37 @@ namespace ante {
      * Compile an expression and merge it with the current AST
      * if it is well-formed.
      */
-    TypedValue mergeAndCompile(Compiler *c, RootNode *rn, ModNode *anteExpr){
+    TypedValue mergeAndCompile(Compiler *c, RootNode *rn, ModNode *anteExpr,
+            llvm::StringMap<Variable*> &bindings){
         TypedValue ret;
         try{
             NameResolutionVisitor v{"repl"};
+
+            // Variables of previous lines are in an outer scope so that
+            // this line may shadow them
+            v.varTable.top().back() = bindings;
+            v.varTable.top().emplace_back();
+
+            // Each line is its own module which imports every previous
+            // line so that their definitions remain visible.
+            if(c->compUnit){
+                for(Module *prev : c->compUnit->imports){
+                    if(prev->name == "repl")
+                        v.compUnit->addImport(prev);
+                }
+                v.compUnit->addImport(c->compUnit);
+            }
+
             size_t errc = errorCount();
             v.visit(rn);
             if(errorCount() > errc) return {};
             TypeInferenceVisitor::infer(rn, v.compUnit);
+            if(errorCount() > errc) return {};
             ret.type = rn->getType();
+            c->compUnit = v.compUnit;
+
+            for(auto &binding : v.varTable.top().back())
+                bindings[binding.getKey()] = binding.getValue();
         }catch(...){
             // return before merging the error-ing expressions
             return {};
@@ -0,0 +1,37 @@
+#include <iostream>
+#include "session.h"
+#include "module.h"
+#include "lexer.h"
+#include "compapi.h"
+
+namespace ante {
+    CompilationSession::CompilationSession()
+        : nodeArena{}, lexer{nullptr}, parseTree{nullptr}, blockRoots{}, rootModule{new Module("")},
+          files{}, fileIds{}, errorCount{0}, typeVarCount{0}, implsAdded{0}, showTimingInformation{false}, coloredOutput{true},
+          exitOnError{true}, diagnostics{&std::cout}, types{}, compapi{}{}
+
+    CompilationSession::~CompilationSession(){
+        delete lexer;
+    }
+
+
+    /** The session made current by the innermost Scope on this thread, if any */
+    thread_local CompilationSession *currentSession = nullptr;
+
+    CompilationSession& CompilationSession::current(){
+        if(currentSession)
+            return *currentSession;
+
+        thread_local CompilationSession defaultSession;
+        return defaultSession;
+    }
+
+
+    CompilationSession::Scope::Scope(CompilationSession &session) : previous{currentSession}{
+        currentSession = &session;
+    }
+
+    CompilationSession::Scope::~Scope(){
+        currentSession = previous;
+    }
+}
@@ -24,7 +24,7 @@ extern int yylex(yy::parser::semantic_type*, yy::location*);
 namespace ante {
     extern string typeNodeToStr(const TypeNode*);
     extern string mangle(std::string const& base, NamedValNode *paramTys);
-    static size_t ante_parser_errcount = 0;
+    static thread_local size_t ante_parser_errcount = 0;
 
     namespace parser {
         struct TypeNode;
@@ -171,7 +171,7 @@ top_level_expr_list: top_level_expr_list top_level_expr  %prec Newline
                    | top_level_expr_list Else expr_no_decl_or_jump                    %prec Else  {$$ = setElse($1, $3);}
                    ;
 
-top_level_expr: modifiers top_level_expr_nm     {$$ = append_modifiers($1, $2);}
+top_level_expr: modifiers top_level_expr_nm     {$$ = append_modifiers(getRoot(), $2);}
               | top_level_expr_nm
               ;
 
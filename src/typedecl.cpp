@@ -70,9 +70,7 @@ namespace ante {
             else return size;
         }else{
             auto t = AnTupleType::get(getBoundFieldTypes(type));
-            auto size = t->getSizeInBits(c, incompleteType);
-            delete t;
-            return size;
+            return t->getSizeInBits(c, incompleteType);
         }
     }
 
@@ -132,7 +130,7 @@ namespace ante {
         }
 
         //allocate for the largest possible union member
-        auto *alloca = c->builder.CreateAlloca(unionTy);
+        auto *alloca = c->compCtxt->stackSlots->create(c->builder, unionTy);
 
         //but bitcast it the the current member
         auto *castTo = c->builder.CreateBitCast(alloca, taggedUnion->getType()->getPointerTo());
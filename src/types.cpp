@@ -26,13 +26,88 @@ char getBitWidthOfTypeTag(const TypeTag ty){
     }
 }
 
-AnType* findBinding(Substitutions const& subs, const AnType *key){
-    for(auto it = subs.rbegin(); it != subs.rend(); ++it){
-        if(it->first == key){
-            return it->second;
+void MonomorphisationBindings::push(){
+    frames.push_back(undoLog.size());
+}
+
+void MonomorphisationBindings::pop(){
+    assert(!frames.empty());
+    size_t frameStart = frames.back();
+    frames.pop_back();
+
+    while(undoLog.size() > frameStart){
+        auto &undo = undoLog.back();
+        if(undo.second)
+            bindings[undo.first] = undo.second;
+        else
+            bindings.erase(undo.first);
+        undoLog.pop_back();
+    }
+}
+
+void MonomorphisationBindings::bind(AnType *typeVar, AnType *type){
+    AnType *&binding = bindings[typeVar];
+    if(!frames.empty())
+        undoLog.emplace_back(typeVar, binding);
+    binding = type;
+}
+
+void MonomorphisationBindings::bind(Substitutions const& subs){
+    for(auto &sub : subs){
+        if(sub.first != sub.second){
+            bind(sub.first, sub.second);
         }
     }
-    return nullptr;
+}
+
+AnType* MonomorphisationBindings::lookup(const AnType *typeVar) const {
+    auto it = bindings.find(typeVar);
+    return it != bindings.end() ? it->second : nullptr;
+}
+
+AnType* MonomorphisationBindings::apply(AnType *t, int recursionLimit) const {
+    if(!t->isGeneric || bindings.empty())
+        return t;
+
+    if(recursionLimit < 0)
+        ASSERT_UNREACHABLE("internal recursion limit (10,000) reached in MonomorphisationBindings::apply");
+
+    auto applyToAll = [&](std::vector<AnType*> const& types){
+        return ante::applyToAll(types, [&](AnType *elem){
+            return apply(elem, recursionLimit - 1);
+        });
+    };
+
+    if(t->isModifierType()){
+        auto modTy = static_cast<AnModifier*>(t);
+        return (AnType*)modTy->addModifiersTo(apply((AnType*)modTy->extTy, recursionLimit - 1));
+    }
+
+    if(auto ptr = try_cast<AnPtrType>(t)){
+        return AnPtrType::get(apply(ptr->elemTy, recursionLimit - 1));
+
+    }else if(auto arr = try_cast<AnArrayType>(t)){
+        return AnArrayType::get(apply(arr->extTy, recursionLimit - 1), arr->len);
+
+    }else if(try_cast<AnTypeVarType>(t)){
+        auto binding = lookup(t);
+        return binding ? apply(binding, recursionLimit - 1) : t;
+
+    }else if(auto dt = try_cast<AnDataType>(t)){
+        return AnDataType::get(dt->name, applyToAll(dt->typeArgs), dt->decl);
+
+    }else if(auto fn = try_cast<AnFunctionType>(t)){
+        auto tcc = ante::applyToAll(fn->typeClassConstraints, [&](TraitImpl *impl){
+            return new TraitImpl(impl->decl, applyToAll(impl->typeArgs), applyToAll(impl->fundeps));
+        });
+        return AnFunctionType::get(apply(fn->retTy, recursionLimit - 1), applyToAll(fn->paramTys), tcc);
+
+    }else if(auto tup = try_cast<AnTupleType>(t)){
+        return AnTupleType::getAnonRecord(applyToAll(tup->fields), tup->fieldNames);
+
+    }else{
+        return t;
+    }
 }
 
 // TODO: Remove hardcoded check for Type type,
@@ -41,7 +116,7 @@ AnType* findBinding(Substitutions const& subs, const AnType *key){
 bool isEmptyType(Compiler *c, AnType *ty){
     auto tv = try_cast<AnTypeVarType>(ty);
     if(tv){
-        auto binding = findBinding(c->compCtxt->monomorphisationMappings, tv);
+        auto binding = c->compCtxt->monomorphisationBindings.lookup(tv);
         return binding ? isEmptyType(c, binding) : true;
     }
     return ty->typeTag == TT_Unit
@@ -58,15 +133,15 @@ AnType* extractTypeValue(const TypedValue &tv){
     return (AnType*) zext;
 }
 
-Result<size_t, string> AnType::getSizeInBits(Compiler *c, string const& incompleteType) const{
+Result<size_t, string> computeSizeInBits(Compiler *c, const AnType *t, string const& incompleteType){
     size_t total = 0;
 
-    if(isPrimitiveTypeTag(this->typeTag))
-        return getBitWidthOfTypeTag(this->typeTag);
+    if(isPrimitiveTypeTag(t->typeTag))
+        return getBitWidthOfTypeTag(t->typeTag);
 
-    if(auto *dataTy = try_cast<AnDataType>(this)){
+    if(auto *dataTy = try_cast<AnDataType>(t)){
         if(dataTy->name == incompleteType){
-            cerr << "Incomplete type " << anTypeToColoredStr(this) << endl;
+            cerr << "Incomplete type " << anTypeToColoredStr(t) << endl;
             throw IncompleteTypeError();
         }
 
@@ -74,23 +149,23 @@ Result<size_t, string> AnType::getSizeInBits(Compiler *c, string const& incomple
 
     // function & metafunction are aggregate types but have different sizes than
     // a tuple so this case must be checked for before AnTupleType is
-    }else if(typeTag == TT_Ptr || typeTag == TT_Function){
+    }else if(t->typeTag == TT_Ptr || t->typeTag == TT_Function){
         return AN_USZ_SIZE;
 
-    }else if(auto *tup = try_cast<AnTupleType>(this)){
+    }else if(auto *tup = try_cast<AnTupleType>(t)){
         for(auto *ext : tup->fields){
             auto val = ext->getSizeInBits(c, incompleteType);
             if(!val) return val;
             total += val.getVal();
         }
 
-    }else if(auto *arr = try_cast<AnArrayType>(this)){
+    }else if(auto *arr = try_cast<AnArrayType>(t)){
         auto val = arr->extTy->getSizeInBits(c, incompleteType);
         if(!val) return val;
         return arr->len * val.getVal();
 
-    }else if(auto *tvt = try_cast<AnTypeVarType>(this)){
-        AnType *lookup = findBinding(c->compCtxt->monomorphisationMappings, tvt);
+    }else if(auto *tvt = try_cast<AnTypeVarType>(t)){
+        AnType *lookup = c->compCtxt->monomorphisationBindings.lookup(tvt);
         if(lookup)
             return lookup->getSizeInBits(c);
         else{
@@ -103,6 +178,26 @@ Result<size_t, string> AnType::getSizeInBits(Compiler *c, string const& incomple
     return total;
 }
 
+Result<size_t, string> AnType::getSizeInBits(Compiler *c, string const& incompleteType) const{
+    if(isGeneric || !c)
+        return computeSizeInBits(c, this, incompleteType);
+
+    auto it = c->compCtxt->typeLayouts.find(this);
+    if(it != c->compCtxt->typeLayouts.end() && it->second.hasSize)
+        return it->second.sizeInBits;
+
+    // Only successful results are cached.  A type that sizes successfully can
+    // never contain the incompleteType of a later call since that type would
+    // then be infinitely recursive.
+    auto size = computeSizeInBits(c, this, incompleteType);
+    if(size){
+        auto &layout = c->compCtxt->typeLayouts[this];
+        layout.sizeInBits = size.getVal();
+        layout.hasSize = true;
+    }
+    return size;
+}
+
 
 size_t hashCombine(size_t l, size_t r){
     return l ^ (r + AN_HASH_PRIME + (l << 6) + (l >> 2));
@@ -171,7 +266,7 @@ Type* typeTagToLlvmType(TypeTag ty, LLVMContext &ctxt){
  *  llvmTypeToTokType, information on signedness of integers is still lost, causing the
  *  unfortunate necessity for the use of a TypedValue for the storage of this information.
  */
-Type* Compiler::anTypeToLlvmType(const AnType *ty, int recursionLimit){
+Type* lowerToLlvmType(Compiler *c, const AnType *ty, int recursionLimit){
     vector<Type*> tys;
     if(!recursionLimit){
         ASSERT_UNREACHABLE("anTypeToLlvmType hit internal recursion limit");
@@ -179,63 +274,75 @@ Type* Compiler::anTypeToLlvmType(const AnType *ty, int recursionLimit){
 
     if(ty->hasModifier(Tok_Mut)){
         auto bm = dynamic_cast<const BasicModifier*>(ty);
-        return anTypeToLlvmType(bm->extTy, --recursionLimit)->getPointerTo();
+        return c->anTypeToLlvmType(bm->extTy, --recursionLimit)->getPointerTo();
     }
 
     switch(ty->typeTag){
         case TT_Ptr: {
             auto *ptr = cast<AnPtrType>(ty);
-            return isEmptyType(this, ptr->elemTy) ?
-                Type::getInt8Ty(*ctxt)->getPointerTo() :
-                anTypeToLlvmType(ptr->elemTy, --recursionLimit)->getPointerTo();
+            return isEmptyType(c, ptr->elemTy) ?
+                Type::getInt8Ty(*c->ctxt)->getPointerTo() :
+                c->anTypeToLlvmType(ptr->elemTy, --recursionLimit)->getPointerTo();
         }
         case TT_Array:{
             auto *arr = cast<AnArrayType>(ty);
-            return ArrayType::get(anTypeToLlvmType(arr->extTy, --recursionLimit), arr->len);
+            return ArrayType::get(c->anTypeToLlvmType(arr->extTy, --recursionLimit), arr->len);
         }
         case TT_Tuple:
             for(auto *e : cast<AnTupleType>(ty)->fields){
-                if(!isEmptyType(this, e))
-                    tys.push_back(anTypeToLlvmType(e, --recursionLimit));
+                if(!isEmptyType(c, e))
+                    tys.push_back(c->anTypeToLlvmType(e, --recursionLimit));
             }
-            return StructType::get(*ctxt, tys);
+            return StructType::get(*c->ctxt, tys);
         case TT_Data: {
             auto *dt = cast<AnDataType>(ty);
-            return dt->decl->toLlvmType(this, dt);
+            return dt->decl->toLlvmType(c, dt);
         }
         case TT_Function: {
             auto *f = try_cast<AnFunctionType>(ty);
             for(size_t i = 0; i < f->paramTys.size(); i++){
                 if(f->paramTys[i]->isRowVar()){
-                    return FunctionType::get(anTypeToLlvmType(f->retTy, --recursionLimit), tys, true)->getPointerTo();
+                    return FunctionType::get(c->anTypeToLlvmType(f->retTy, --recursionLimit), tys, true)->getPointerTo();
                 }
                 // All Ante functions take at least 1 arg: (), which are ignored in llvm ir
                 // and translated to 0 arg functions instead
-                if(!isEmptyType(this, f->paramTys[i]))
-                    tys.push_back(anTypeToLlvmType(f->paramTys[i], --recursionLimit));
+                if(!isEmptyType(c, f->paramTys[i]))
+                    tys.push_back(c->anTypeToLlvmType(f->paramTys[i], --recursionLimit));
             }
 
-            return FunctionType::get(anTypeToLlvmType(f->retTy, --recursionLimit), tys, false)->getPointerTo();
+            return FunctionType::get(c->anTypeToLlvmType(f->retTy, --recursionLimit), tys, false)->getPointerTo();
         }
         case TT_TypeVar: {
-            auto binding = findBinding(compCtxt->monomorphisationMappings, ty); 
+            auto binding = c->compCtxt->monomorphisationBindings.lookup(ty);
             if(binding){
-                return anTypeToLlvmType(binding, --recursionLimit);
+                return c->anTypeToLlvmType(binding, --recursionLimit);
              }else{
                  // typevars that survive monomorphisation are values that are never used,
                  // so we treat them as () here
                  auto unit = AnType::getUnit();
-                 compCtxt->insertMonomorphisationMappings({{(AnType*)ty, unit}});
-                 return anTypeToLlvmType(unit, --recursionLimit);
+                 c->compCtxt->monomorphisationBindings.bind((AnType*)ty, unit);
+                 return c->anTypeToLlvmType(unit, --recursionLimit);
             }
-            std::cerr << "Typevar: " << (AnType*)ty << '\n' << "Bindings: " << compCtxt->monomorphisationMappings << '\n';
-            ASSERT_UNREACHABLE("Unbound typevar found during monomorphisation");
         }
         default:
-            return typeTagToLlvmType(ty->typeTag, *ctxt);
+            return typeTagToLlvmType(ty->typeTag, *c->ctxt);
     }
 }
 
+Type* Compiler::anTypeToLlvmType(const AnType *ty, int recursionLimit){
+    if(ty->isGeneric)
+        return lowerToLlvmType(this, ty, recursionLimit);
+
+    auto it = compCtxt->typeLayouts.find(ty);
+    if(it != compCtxt->typeLayouts.end() && it->second.llvmType)
+        return it->second.llvmType;
+
+    // The map may grow while lowering ty's fields so it is searched again afterward
+    auto *llvmType = lowerToLlvmType(this, ty, recursionLimit);
+    compCtxt->typeLayouts[ty].llvmType = llvmType;
+    return llvmType;
+}
+
 /*
  *  Converts a TypeTag to its string equivalent for
  *  helpful error messages.  For most cases, llvmTypeToStr
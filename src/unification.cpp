@@ -2,12 +2,12 @@
 #include "types.h"
 #include "trait.h"
 #include "util.h"
+#include "session.h"
 
 namespace ante {
-    size_t curTypeVar = 0;
-
     AnTypeVarType* nextTypeVar(){
-        return AnTypeVarType::get('\'' + std::to_string(++curTypeVar));
+        auto &count = CompilationSession::current().typeVarCount;
+        return AnTypeVarType::get('\'' + std::to_string(++count));
     }
 
     template<typename T>
@@ -292,151 +292,387 @@ namespace ante {
     }
 
 
-    AnType* applySubstitutions(Substitutions const& substitutions, AnType *t){
-        for(auto it = substitutions.rbegin(); it != substitutions.rend(); ++it){
-            t = substitute(it->second, it->first, t);
+    Substitutions::Substitutions(std::initializer_list<std::pair<AnType*, AnType*>> bindings){
+        for(auto &pair : bindings){
+            if(auto tv = try_cast<AnTypeVarType>(pair.first))
+                bind(tv, pair.second);
+        }
+    }
+
+    Substitutions::Node& Substitutions::getNode(AnTypeVarType *tv){
+        auto it = forest.find(tv);
+        if(it != forest.end())
+            return it->second;
+
+        order.push_back(tv);
+        return forest.emplace(tv, Node{tv, tv, nullptr, 0}).first->second;
+    }
+
+    void Substitutions::invalidateCaches(){
+        if(!resolved.empty())
+            resolved.clear();
+        bindingListIsValid = false;
+    }
+
+    AnTypeVarType* Substitutions::find(AnTypeVarType *tv) const {
+        auto it = forest.find(tv);
+        if(it == forest.end())
+            return tv;
+
+        AnTypeVarType *root = it->second.parent;
+        while(true){
+            AnTypeVarType *parent = forest.find(root)->second.parent;
+            if(parent == root) break;
+            root = parent;
+        }
+
+        // path compression
+        while(tv != root){
+            Node &node = forest.find(tv)->second;
+            tv = node.parent;
+            node.parent = root;
+        }
+        return root;
+    }
+
+    void Substitutions::bind(AnTypeVarType *tv, AnType *t){
+        invalidateCaches();
+        AnTypeVarType *root1 = find(tv);
+
+        if(t->typeTag != TT_TypeVar || t->isModifierType()){
+            getNode(root1).binding = t;
+            return;
+        }
+
+        AnTypeVarType *root2 = find(static_cast<AnTypeVarType*>(t));
+        if(root1 == root2)
+            return;
+
+        Node &n1 = getNode(root1);
+        Node &n2 = getNode(root2);
+        AnTypeVarType *canonical = n2.canonical;
+        AnType *binding = n2.binding ? n2.binding : n1.binding;
+
+        Node *newRoot;
+        if(n1.rank < n2.rank){
+            n1.parent = root2;
+            newRoot = &n2;
+        }else{
+            n2.parent = root1;
+            if(n1.rank == n2.rank)
+                n1.rank++;
+            newRoot = &n1;
+        }
+        newRoot->canonical = canonical;
+        newRoot->binding = binding;
+    }
+
+    AnType* Substitutions::shallowResolve(AnType *t) const {
+        while(auto tv = try_cast<AnTypeVarType>(t)){
+            auto it = forest.find(find(tv));
+            if(it == forest.end())
+                return t;
+
+            Node const& root = it->second;
+            if(!root.binding)
+                return t->isModifierType() ? t : root.canonical;
+
+            t = t->isModifierType()
+                ? (AnType*)static_cast<AnModifier*>(t)->addModifiersTo(root.binding)
+                : root.binding;
         }
         return t;
     }
 
-    TraitImpl* applySubstitutions(Substitutions const& substitutions, TraitImpl *t){
-        auto ret = new TraitImpl(t->decl, t->typeArgs, t->fundeps);
-        for(auto it = substitutions.rbegin(); it != substitutions.rend(); ++it){
-            ret->typeArgs = ante::applyToAll(ret->typeArgs, [it](AnType *type){
-                return substitute(it->second, it->first, type);
+    template<class T>
+    std::vector<T*> resolveAll(Substitutions const& subs, std::vector<T*> const& vec){
+        return ante::applyToAll(vec, [&](T *elem){
+            return (T*)subs.resolve(elem);
+        });
+    }
+
+    AnType* Substitutions::resolve(AnType *t) const {
+        if(!t->isGeneric || forest.empty())
+            return t;
+
+        if(t->isModifierType()){
+            auto modTy = static_cast<AnModifier*>(t);
+            return (AnType*)modTy->addModifiersTo(resolve((AnType*)modTy->extTy));
+        }
+
+        if(auto ptr = try_cast<AnPtrType>(t)){
+            return AnPtrType::get(resolve(ptr->elemTy));
+
+        }else if(auto arr = try_cast<AnArrayType>(t)){
+            return AnArrayType::get(resolve(arr->extTy), arr->len);
+
+        }else if(auto tv = try_cast<AnTypeVarType>(t)){
+            AnTypeVarType *root = find(tv);
+            auto it = forest.find(root);
+            if(it == forest.end())
+                return t;
+
+            auto memo = resolved.find(root);
+            if(memo != resolved.end())
+                return memo->second;
+
+            Node const& node = it->second;
+            AnType *ret = node.binding ? resolve(node.binding) : node.canonical;
+            resolved[root] = ret;
+            return ret;
+
+        }else if(auto dt = try_cast<AnDataType>(t)){
+            return AnDataType::get(dt->name, resolveAll(*this, dt->typeArgs), dt->decl);
+
+        }else if(auto fn = try_cast<AnFunctionType>(t)){
+            auto tcc = ante::applyToAll(fn->typeClassConstraints, [&](TraitImpl *impl){
+                auto typeArgs = resolveAll(*this, impl->typeArgs);
+                auto fundeps = resolveAll(*this, impl->fundeps);
+
+                // Reuse unchanged constraints so the interned function type can be reused too
+                if(typeArgs == impl->typeArgs && fundeps == impl->fundeps)
+                    return impl;
+                return new TraitImpl(impl->decl, typeArgs, fundeps);
             });
+            return AnFunctionType::get(resolve(fn->retTy), resolveAll(*this, fn->paramTys), tcc);
+
+        }else if(auto tup = try_cast<AnTupleType>(t)){
+            return AnTupleType::getAnonRecord(resolveAll(*this, tup->fields), tup->fieldNames);
+
+        }else{
+            return t;
         }
-        return ret;
+    }
+
+    /** Walk t after resolution, returning true if f returns true for any unbound type variable */
+    template<class F>
+    bool anyUnboundTypeVar(Substitutions const& subs, const AnType *t, F f){
+        if(!t->isGeneric)
+            return false;
+
+        if(t->isModifierType()){
+            return anyUnboundTypeVar(subs, static_cast<const AnModifier*>(t)->extTy, f);
+        }
+
+        auto anyIn = [&](std::vector<AnType*> const& tys){
+            return ante::any(tys, [&](AnType *elem){ return anyUnboundTypeVar(subs, elem, f); });
+        };
+
+        if(auto ptr = try_cast<AnPtrType>(t)){
+            return anyUnboundTypeVar(subs, ptr->elemTy, f);
+
+        }else if(auto arr = try_cast<AnArrayType>(t)){
+            return anyUnboundTypeVar(subs, arr->extTy, f);
+
+        }else if(auto tv = try_cast<AnTypeVarType>(t)){
+            AnType *binding = subs.shallowResolve((AnType*)tv);
+            if(auto unbound = try_cast<AnTypeVarType>(binding))
+                return f(subs.find(unbound));
+            return anyUnboundTypeVar(subs, binding, f);
+
+        }else if(auto dt = try_cast<AnDataType>(t)){
+            return anyIn(dt->typeArgs);
+
+        }else if(auto fn = try_cast<AnFunctionType>(t)){
+            return anyIn(fn->paramTys)
+                || anyUnboundTypeVar(subs, fn->retTy, f)
+                || ante::any(fn->typeClassConstraints, [&](TraitImpl *impl){ return anyIn(impl->typeArgs); });
+
+        }else if(auto tup = try_cast<AnTupleType>(t)){
+            return anyIn(tup->fields);
+
+        }else{
+            return false;
+        }
+    }
+
+    bool Substitutions::containsUnboundTypeVar(AnType *t) const {
+        return anyUnboundTypeVar(*this, t, [](AnTypeVarType*){ return true; });
+    }
+
+    bool Substitutions::occurs(AnTypeVarType *tv, AnType *t) const {
+        AnTypeVarType *root = find(tv);
+        if(t->typeTag == TT_TypeVar && !t->isModifierType() && find(static_cast<AnTypeVarType*>(t)) == root)
+            return false;
+
+        return anyUnboundTypeVar(*this, t, [root](AnTypeVarType *other){ return other == root; });
+    }
+
+    size_t Substitutions::size() const {
+        return end() - begin();
+    }
+
+    Substitutions::const_iterator Substitutions::begin() const {
+        if(!bindingListIsValid){
+            bindingList.clear();
+            for(AnTypeVarType *tv : order){
+                AnType *t = resolve(tv);
+                if(t != tv)
+                    bindingList.emplace_back(tv, t);
+            }
+            bindingListIsValid = true;
+        }
+        return bindingList.cbegin();
+    }
+
+    Substitutions::const_iterator Substitutions::end() const {
+        begin();
+        return bindingList.cend();
+    }
+
+
+    AnType* applySubstitutions(Substitutions const& substitutions, AnType *t){
+        return substitutions.resolve(t);
+    }
+
+    TraitImpl* applySubstitutions(Substitutions const& substitutions, TraitImpl *t){
+        return new TraitImpl(t->decl, resolveAll(substitutions, t->typeArgs), t->fundeps);
     }
 
     enum TypeErrorKind {
         Mismatch, InfRecursion1, InfRecursion2
     };
 
-    struct TypeErrorContext : public std::exception {
+    /** Describes the first pair of types that failed to unify */
+    struct TypeErrorContext {
         const AnType *t1, *t2;
-        const TypeErrorKind kind;
-        Substitutions subs;
+        TypeErrorKind kind;
+
+        TypeErrorContext() : t1{nullptr}, t2{nullptr}, kind{Mismatch}{}
 
         TypeErrorContext(const AnType *t1, const AnType *t2, TypeErrorKind kind)
-            : t1{t1}, t2{t2}, kind{kind}, subs{}{}
+            : t1{t1}, t2{t2}, kind{kind}{}
     };
 
-    Substitutions unify(UnificationList const& list, UnificationList::const_reverse_iterator cur, bool isTopLevel);
+    using Equation = std::pair<AnType*, AnType*>;
 
-    /**
-     * Helper for a recursive call to unify.
-     * Supplies arguments needed for good error messages.
-     */
-    Substitutions unifyRecursive(UnificationList const& list){
-        return unify(list, list.rbegin(), false);
+    /** Push each pair of elements onto the work stack so that the first pair is unified first */
+    template<class T>
+    void pushEquations(std::vector<Equation> &work, std::vector<T*> const& exts1,
+            std::vector<T*> const& exts2, size_t len){
+
+        for(size_t i = len; i > 0; i--)
+            work.emplace_back(exts1[i - 1], exts2[i - 1]);
     }
 
-    template<class T>
-    Substitutions unifyExts(std::vector<T*> const& exts1, std::vector<T*> const& exts2,
-            const AnType *t1, const AnType *t2, TypeError const& err){
+    /** Returns false if the tuples can never unify because their lengths differ */
+    bool pushTupleEquations(Substitutions const& subs, std::vector<Equation> &work,
+            AnTupleType *tup1, AnTupleType *tup2){
 
-        if(exts1.size() != exts2.size()){
-            throw TypeErrorContext(t1, t2, Mismatch);
-        }
+        // A row variable may have already been bound to a concrete type
+        auto hasRowVar = [&](AnTupleType *tup){
+            return !tup->fields.empty() && subs.shallowResolve(tup->fields.back())->isRowVar();
+        };
 
-        UnificationList ret;
-        for(size_t i = 0; i < exts1.size(); i++)
-            ret.emplace_back(exts1[i], exts2[i], err);
-        return unifyRecursive(ret);
-    }
+        bool tup1HasRowVar = hasRowVar(tup1);
+        bool tup2HasRowVar = hasRowVar(tup2);
 
-    Substitutions unifyTuple(AnTupleType *tup1, AnTupleType *tup2, TypeError const& err){
         auto len1 = tup1->fields.size();
         auto len2 = tup2->fields.size();
-        if(tup1->hasRowVar()) len1--;
-        if(tup2->hasRowVar()) len2--;
+        if(tup1HasRowVar) len1--;
+        if(tup2HasRowVar) len2--;
 
         if(len1 != len2){
             if(len1 < len2){
-                if(tup1->hasRowVar()){
-                    len2 = len1;
-                }else{
-                    throw TypeErrorContext(tup1, tup2, Mismatch);
-                }
+                if(!tup1HasRowVar)
+                    return false;
             }else{
-                if(tup2->hasRowVar()){
-                    len1 = len2;
-                }else{
-                    throw TypeErrorContext(tup1, tup2, Mismatch);
-                }
+                if(!tup2HasRowVar)
+                    return false;
+                len1 = len2;
             }
         }
-
-        UnificationList ret;
-        for(size_t i = 0; i < len1; i++)
-            ret.emplace_back(tup1->fields[i], tup2->fields[i], err);
-        return unifyRecursive(ret);
+        pushEquations(work, tup1->fields, tup2->fields, len1);
+        return true;
     }
 
+    /**
+     * Unify a and b, adding any new bindings to subs.
+     *
+     * Sub-equations are kept on an explicit stack rather than recursing so
+     * that deeply nested types cannot overflow the native stack.  They are
+     * solved in the same depth-first, left to right order as before.
+     *
+     * Failure is reported through the return value rather than an exception
+     * since trait resolution expects most candidate impls to fail.  Any
+     * bindings made before the failure are left in subs.  If err is non-null
+     * it is filled with the offending types on failure.
+     */
+    bool unifyOne(Substitutions &subs, AnType *a, AnType *b, TypeErrorContext *err = nullptr){
+        std::vector<Equation> work{{a, b}};
 
-    Substitutions unifyOne(AnType *t1, AnType *t2, TypeError const& err){
-        auto tv1 = try_cast<AnTypeVarType>(t1);
-        auto tv2 = try_cast<AnTypeVarType>(t2);
-
-        if(tv1){
-            if(containsTypeVar(t2, tv1)){
-                throw TypeErrorContext(t1, t2, InfRecursion1);
-            }
-            return {{tv1, t2}};
-        }else if(tv2){
-            if(containsTypeVar(t1, tv2)){
-                throw TypeErrorContext(t1, t2, InfRecursion2);
-            }
-            return {{tv2, t1}};
-        }
+        auto fail = [&](AnType *t1, AnType *t2, TypeErrorKind kind){
+            if(err)
+                *err = TypeErrorContext(subs.resolve(t1), subs.resolve(t2), kind);
+            return false;
+        };
 
-        if(t1->typeTag != t2->typeTag){
-            throw TypeErrorContext(t1, t2, Mismatch);
-        }
+        while(!work.empty()){
+            auto eq = work.back();
+            work.pop_back();
 
-        UnificationList ret;
+            AnType *t1 = subs.shallowResolve(eq.first);
+            AnType *t2 = subs.shallowResolve(eq.second);
+            auto tv1 = try_cast<AnTypeVarType>(t1);
+            auto tv2 = try_cast<AnTypeVarType>(t2);
 
-        if(!t1->isGeneric && !t2->isGeneric){
-            if(!t1->approxEq(t2)){
-                throw TypeErrorContext(t1, t2, Mismatch);
+            if(tv1){
+                if(subs.occurs(tv1, t2)){
+                    return fail(t1, t2, InfRecursion1);
+                }
+                subs.bind(tv1, t2);
+                continue;
+            }else if(tv2){
+                if(subs.occurs(tv2, t1)){
+                    return fail(t1, t2, InfRecursion2);
+                }
+                subs.bind(tv2, t1);
+                continue;
             }
-            return {};
-        }
 
-        if(auto ptr1 = try_cast<AnPtrType>(t1)){
-            auto ptr2 = try_cast<AnPtrType>(t2);
-            ret.emplace_back(ptr1->elemTy, ptr2->elemTy, err);
-            return unifyRecursive(ret);
+            if(t1->typeTag != t2->typeTag){
+                return fail(t1, t2, Mismatch);
+            }
 
-        }else if(auto arr1 = try_cast<AnArrayType>(t1)){
-            auto arr2 = try_cast<AnArrayType>(t2);
-            ret.emplace_back(arr1->extTy, arr2->extTy, err);
-            return unifyRecursive(ret);
+            if(!subs.containsUnboundTypeVar(t1) && !subs.containsUnboundTypeVar(t2)){
+                if(!subs.resolve(t1)->approxEq(subs.resolve(t2))){
+                    return fail(t1, t2, Mismatch);
+                }
+                continue;
+            }
 
-        }else if(auto dt1 = try_cast<AnDataType>(t1)){
-            auto dt2 = try_cast<AnDataType>(t2);
-            return unifyExts(dt1->typeArgs, dt2->typeArgs, dt1, dt2, err);
+            if(auto ptr1 = try_cast<AnPtrType>(t1)){
+                auto ptr2 = try_cast<AnPtrType>(t2);
+                work.emplace_back(ptr1->elemTy, ptr2->elemTy);
 
-        }else if(auto fn1 = try_cast<AnFunctionType>(t1)){
-            auto fn2 = try_cast<AnFunctionType>(t2);
-            if(fn1->paramTys.size() != fn2->paramTys.size()){
-                throw TypeErrorContext(t1, t2, Mismatch);
-            }
+            }else if(auto arr1 = try_cast<AnArrayType>(t1)){
+                auto arr2 = try_cast<AnArrayType>(t2);
+                work.emplace_back(arr1->extTy, arr2->extTy);
 
-            for(size_t i = 0; i < fn1->paramTys.size(); i++)
-                ret.emplace_back(fn1->paramTys[i], fn2->paramTys[i], err);
+            }else if(auto dt1 = try_cast<AnDataType>(t1)){
+                auto dt2 = try_cast<AnDataType>(t2);
+                if(dt1->typeArgs.size() != dt2->typeArgs.size()){
+                    return fail(t1, t2, Mismatch);
+                }
+                pushEquations(work, dt1->typeArgs, dt2->typeArgs, dt1->typeArgs.size());
 
-            ret.emplace_back(fn1->retTy, fn2->retTy, err);
-            return unifyRecursive(ret);
+            }else if(auto fn1 = try_cast<AnFunctionType>(t1)){
+                auto fn2 = try_cast<AnFunctionType>(t2);
+                if(fn1->paramTys.size() != fn2->paramTys.size()){
+                    return fail(t1, t2, Mismatch);
+                }
 
-        }else if(auto tup1 = try_cast<AnTupleType>(t1)){
-            auto tup2 = try_cast<AnTupleType>(t2);
-            return unifyTuple(tup1, tup2, err);
+                work.emplace_back(fn1->retTy, fn2->retTy);
+                pushEquations(work, fn1->paramTys, fn2->paramTys, fn1->paramTys.size());
 
-        }else{
-            return {};
+            }else if(auto tup1 = try_cast<AnTupleType>(t1)){
+                auto tup2 = try_cast<AnTupleType>(t2);
+                if(!pushTupleEquations(subs, work, tup1, tup2)){
+                    return fail(t1, t2, Mismatch);
+                }
+            }
         }
+        return true;
     }
 
 
@@ -445,81 +681,45 @@ namespace ante {
     }
 
 
-    Substitutions unify(UnificationList const& list, UnificationList::const_reverse_iterator cur, bool isTopLevel){
-        if(cur == list.rend()){
-            return {};
-        }else{
-            auto &p = *cur;
-            auto t2 = unify(list, ++cur, isTopLevel);
+    Substitutions unify(UnificationList const& list){
+        Substitutions subs;
 
+        for(auto &p : list){
             if(!p.isEqConstraint()){
-                auto tc = p.asTypeClassConstraint();
-                unifyTypeClassConstraint(applySubstitutions(t2, tc));
-                return t2;
+                unifyTypeClassConstraint(p.asTypeClassConstraint());
+                continue;
             }
 
-            try{
-                auto eq = p.asEqConstraint();
-
-                Substitutions t1;
-                try {
-                    t1 = unifyOne(applySubstitutions(t2, eq.first),
-                                  applySubstitutions(t2, eq.second), p.error);
-                }catch(TypeErrorContext& e){
-                    e.subs.insert(e.subs.end(), t2.begin(), t2.end());
-                    if(!isTopLevel){
-                        throw e;
-                    }
-
-                    p.error.show(applySubstitutions(e.subs, eq.first), applySubstitutions(e.subs, eq.second));
-                    if(e.kind == InfRecursion1)
-                        showError(anTypeToColoredStr(e.t1) + " occurs inside " + anTypeToColoredStr(e.t2), p.error.loc, ErrorType::Note);
-                    if(e.kind == InfRecursion2)
-                        showError(anTypeToColoredStr(e.t2) + " occurs inside " + anTypeToColoredStr(e.t1), p.error.loc, ErrorType::Note);
-                    return {};
-                }
-
-                Substitutions ret = t1;
-                ret.insert(ret.end(), t2.begin(), t2.end());
-                return ret;
-            }catch(CtError e){
-                return t2;
+            auto eq = p.asEqConstraint();
+            TypeErrorContext e;
+            if(!unifyOne(subs, eq.first, eq.second, &e)){
+                // Any bindings made before the error are kept so that the
+                // remaining constraints are still checked against them.
+                p.error.show(subs.resolve(eq.first), subs.resolve(eq.second));
+                if(e.kind == InfRecursion1)
+                    showError(anTypeToColoredStr(e.t1) + " occurs inside " + anTypeToColoredStr(e.t2), p.error.loc, ErrorType::Note);
+                if(e.kind == InfRecursion2)
+                    showError(anTypeToColoredStr(e.t2) + " occurs inside " + anTypeToColoredStr(e.t1), p.error.loc, ErrorType::Note);
             }
         }
-    }
-
-    Substitutions unify(UnificationList const& cur){
-        return unify(cur, cur.rbegin(), true);
+        return subs;
     }
 
     std::pair<bool, Substitutions> tryUnify(AnType *a, AnType *b){
-        yy::location loc;
-        TypeError empty{loc};
         Substitutions subs;
-
-        // TODO: type errors were designed to be exceptional but we're using
-        // them as control-flow here.  Possible optimization point for traits
-        try {
-            subs = unifyOne(a, b, empty);
-            return {true, subs};
-        }catch(TypeErrorContext const& err){
-            return {false, subs};
-        }
+        bool success = unifyOne(subs, a, b);
+        return {success, std::move(subs)};
     }
 
     std::pair<bool, Substitutions> tryUnify(std::vector<AnType*> const& a, std::vector<AnType*> const& b){
-        yy::location loc;
-        TypeError empty{loc};
         Substitutions subs;
+        if(a.size() != b.size())
+            return {false, std::move(subs)};
 
-        // TODO: type errors were designed to be exceptional but we're using
-        // them as control-flow here.  Possible optimization point for traits
-        try {
-            auto fakeTy = AnType::getUnit();
-            subs = unifyExts(a, b, fakeTy, fakeTy, empty);
-            return {true, subs};
-        }catch(TypeErrorContext const& err){
-            return {false, subs};
+        for(size_t i = 0; i < a.size(); i++){
+            if(!unifyOne(subs, a[i], b[i]))
+                return {false, std::move(subs)};
         }
+        return {true, std::move(subs)};
     }
 }
@@ -0,0 +1,38 @@
+#include "unittest.h"
+#include "antevalue.h"
+using namespace ante;
+using namespace llvm;
+
+TEST_CASE("Values are marshalled with the JIT's data layout", "[AnteValue]"){
+    auto&& c = Compiler(nullptr);
+    auto *i8 = AnType::getI8();
+    auto *i64 = AnType::getI64();
+    auto *tupTy = AnTupleType::get({i8, i64, i8});
+
+    REQUIRE(getMarshalledSize(&c, AnType::getUnit()) == 0);
+    REQUIRE(getMarshalledSize(&c, tupTy) == 24);
+
+    auto *tup = ConstantStruct::get(cast<StructType>(c.anTypeToLlvmType(tupTy)), {
+        ConstantInt::get(c.anTypeToLlvmType(i8), 1),
+        ConstantInt::get(c.anTypeToLlvmType(i64), 2),
+        ConstantInt::get(c.anTypeToLlvmType(i8), 3)
+    });
+
+    AnteValue val{&c, TypedValue(tup, tupTy)};
+    char *data = (char*)val.asRawData();
+    REQUIRE(*(int8_t*)data == 1);
+    REQUIRE(*(int64_t*)(data + 8) == 2);
+    REQUIRE(*(int8_t*)(data + 16) == 3);
+    REQUIRE(val.asTypedValue(&c).val == tup);
+}
+
+TEST_CASE("Arrays are marshalled in bulk", "[AnteValue]"){
+    auto&& c = Compiler(nullptr);
+    auto *arrTy = AnArrayType::get(AnType::getI32(), 4);
+    uint32_t elems[] = {1, 2, 3, 4};
+    auto *arr = ConstantDataArray::get(*c.ctxt, makeArrayRef(elems));
+
+    AnteValue val{&c, TypedValue(arr, arrTy)};
+    REQUIRE(memcmp(val.asRawData(), elems, sizeof(elems)) == 0);
+    REQUIRE(val.asTypedValue(&c).val == arr);
+}
@@ -0,0 +1,88 @@
+#include "unittest.h"
+#include <llvm/IR/IRBuilder.h>
+using namespace ante;
+using namespace llvm;
+
+TEST_CASE("Pure functions are detected from their IR", "[CtfeCache]"){
+    LLVMContext ctxt;
+    llvm::Module module{"test", ctxt};
+    IRBuilder<> builder{ctxt};
+    auto *i32 = builder.getInt32Ty();
+    auto *fnTy = FunctionType::get(i32, {i32}, false);
+
+    auto *global = new GlobalVariable(module, i32, false, GlobalValue::PrivateLinkage, builder.getInt32(0), "counter");
+    auto *table = new GlobalVariable(module, i32, true, GlobalValue::PrivateLinkage, builder.getInt32(7), "table");
+    auto *external = Function::Create(fnTy, Function::ExternalLinkage, "external", &module);
+
+    //square x = let slot = x in slot * slot + table
+    auto *square = Function::Create(fnTy, Function::ExternalLinkage, "square", &module);
+    builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", square));
+    auto *slot = builder.CreateAlloca(i32);
+    builder.CreateStore(&*square->arg_begin(), slot);
+    auto *x = builder.CreateLoad(slot);
+    auto *sum = builder.CreateAdd(builder.CreateMul(x, x), builder.CreateLoad(table));
+    builder.CreateRet(sum);
+
+    auto *callsSquare = Function::Create(fnTy, Function::ExternalLinkage, "callsSquare", &module);
+    builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", callsSquare));
+    builder.CreateRet(builder.CreateCall(square, {&*callsSquare->arg_begin()}));
+
+    auto *writesGlobal = Function::Create(fnTy, Function::ExternalLinkage, "writesGlobal", &module);
+    builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", writesGlobal));
+    builder.CreateStore(&*writesGlobal->arg_begin(), global);
+    builder.CreateRet(builder.getInt32(0));
+
+    auto *callsExternal = Function::Create(fnTy, Function::ExternalLinkage, "callsExternal", &module);
+    builder.SetInsertPoint(BasicBlock::Create(ctxt, "entry", callsExternal));
+    builder.CreateRet(builder.CreateCall(external, {&*callsExternal->arg_begin()}));
+
+    CtfeCache cache;
+    REQUIRE(cache.isPure(square));
+    REQUIRE(cache.isPure(callsSquare));
+    REQUIRE_FALSE(cache.isPure(writesGlobal));
+    REQUIRE_FALSE(cache.isPure(callsExternal));
+}
+
+TEST_CASE("CTFE results are keyed by function, argument types and bytes", "[CtfeCache]"){
+    auto&& c = Compiler(nullptr);
+    FuncDecl f{nullptr, "f", nullptr};
+    FuncDecl g{nullptr, "g", nullptr};
+    std::vector<AnType*> i32{AnType::getI32()};
+    std::vector<AnType*> u32{AnType::getU32()};
+
+    CtfeCache cache;
+    REQUIRE(cache.lookup(&f, i32, "abcd") == nullptr);
+
+    cache.store(&f, i32, "abcd", "result");
+    auto *result = cache.lookup(&f, i32, "abcd");
+    REQUIRE(result != nullptr);
+    REQUIRE(*result == "result");
+
+    REQUIRE(cache.lookup(&g, i32, "abcd") == nullptr);
+    REQUIRE(cache.lookup(&f, u32, "abcd") == nullptr);
+    REQUIRE(cache.lookup(&f, i32, "abce") == nullptr);
+    REQUIRE(cache.hits == 1);
+    REQUIRE(cache.misses == 4);
+}
+
+TEST_CASE("Aggregate CTFE results are loaded from shared constant globals", "[CtfeCache]"){
+    auto&& c = Compiler(nullptr);
+    auto *fnTy = FunctionType::get(c.builder.getVoidTy(), false);
+    auto *fn = Function::Create(fnTy, Function::ExternalLinkage, "main", c.module.get());
+    c.builder.SetInsertPoint(BasicBlock::Create(*c.ctxt, "entry", fn));
+
+    uint32_t elems[] = {0, 1, 4, 9};
+    auto *arrTy = AnArrayType::get(AnType::getU32(), 4);
+    TypedValue table{ConstantDataArray::get(*c.ctxt, makeArrayRef(elems)), arrTy};
+
+    auto first = loadCtConstant(&c, table);
+    auto second = loadCtConstant(&c, table);
+    REQUIRE(isa<LoadInst>(first.val));
+    REQUIRE(cast<LoadInst>(first.val)->getPointerOperand() == cast<LoadInst>(second.val)->getPointerOperand());
+    REQUIRE(cast<GlobalVariable>(cast<LoadInst>(first.val)->getPointerOperand())->isConstant());
+    REQUIRE(getCtConstant(&c, first.val) == table.val);
+
+    //scalars are left as they are
+    TypedValue scalar{c.builder.getInt32(3), AnType::getI32()};
+    REQUIRE(loadCtConstant(&c, scalar).val == scalar.val);
+}
@@ -0,0 +1,37 @@
+#include "unittest.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <fstream>
+using namespace ante;
+
+TEST_CASE("Instances with trait constraints are reused", "[monomorphise]"){
+    llvm::SmallString<128> dir;
+    REQUIRE(!llvm::sys::fs::createUniqueDirectory("antetest", dir));
+    llvm::sys::path::append(dir, "instances.an");
+
+    std::ofstream{dir.str().str()} <<
+        "trait Double 't\n"
+        "    double 't -> 't\n"
+        "\n"
+        "impl Double i32\n"
+        "    double (x:i32) = x + x\n"
+        "\n"
+        "quadruple x = double (double x)\n"
+        "\n"
+        "quadruple 1\n"
+        "quadruple 2\n"
+        "quadruple 3\n";
+
+    CompilationSession session;
+    CompilationSession::Scope scope{session};
+    {
+        Compiler c{dir.c_str()};
+        c.compile();
+
+        //each call to quadruple has its own TraitImpl for Double i32
+        REQUIRE(c.compCtxt->instancesCompiled == 1);
+        REQUIRE(c.compCtxt->instancesReused == 2);
+    }
+
+    llvm::sys::fs::remove_directories(llvm::sys::path::parent_path(dir));
+}
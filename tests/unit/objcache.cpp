@@ -0,0 +1,77 @@
+#include "unittest.h"
+#include "objcache.h"
+#include "jit.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <fstream>
+using namespace ante;
+
+namespace {
+    std::string writeFile(llvm::SmallString<128> const& dir, std::string const& name, std::string const& contents){
+        llvm::SmallString<128> path{dir};
+        llvm::sys::path::append(path, name);
+        std::ofstream{path.str().str()} << contents;
+        return path.str().str();
+    }
+}
+
+TEST_CASE("Object cache entries are invalidated by their dependencies", "[ObjectCache]"){
+    llvm::SmallString<128> dir;
+    REQUIRE(!llvm::sys::fs::createUniqueDirectory("antecache", dir));
+
+    auto source = writeFile(dir, "main.an", "import Lib");
+    auto lib = writeFile(dir, "lib.an", "k () = 3");
+    auto obj = writeFile(dir, "main.o", "object");
+
+    llvm::SmallString<128> cacheDir{dir};
+    llvm::sys::path::append(cacheDir, "cache");
+    ObjectCache cache{cacheDir.str().str(), 0};
+
+    auto key = cache.getKey(source, "-O 2");
+    REQUIRE(!key.empty());
+    REQUIRE(key != cache.getKey(source, "-O 3"));
+    REQUIRE(key != cache.getKey(source, "-O 2 -lib"));
+    REQUIRE(cache.lookup(key).empty());
+
+    cache.store(key, {obj}, {&source, &lib});
+    auto cached = cache.lookup(key);
+    REQUIRE(cached.size() == 1);
+    REQUIRE(cached[0] != obj);
+
+    //changing an imported file must not reuse the object compiled against its old contents
+    writeFile(dir, "lib.an", "k () = 4");
+    REQUIRE(cache.lookup(key).empty());
+
+    //changing the module itself changes its key
+    writeFile(dir, "main.an", "import Lib\nk ()");
+    REQUIRE(cache.getKey(source, "-O 2") != key);
+
+    llvm::sys::fs::remove_directories(dir);
+}
+
+TEST_CASE("JIT-compiled objects share the cache directory", "[ObjectCache]"){
+    llvm::SmallString<128> dir;
+    REQUIRE(!llvm::sys::fs::createUniqueDirectory("antecache", dir));
+
+    llvm::SmallString<128> cacheDir{dir};
+    llvm::sys::path::append(cacheDir, "cache");
+    JitObjectCache cache{cacheDir.str().str()};
+
+    llvm::LLVMContext ctxt;
+    llvm::Module module{"0123abcd", ctxt};
+    REQUIRE(cache.getObject(&module) == nullptr);
+
+    std::string obj = "object";
+    cache.notifyObjectCompiled(&module, llvm::MemoryBufferRef(obj, "obj"));
+    auto cached = cache.getObject(&module);
+    REQUIRE(cached != nullptr);
+    REQUIRE(cached->getBuffer() == obj);
+    REQUIRE(cache.hits == 1);
+    REQUIRE(cache.misses == 1);
+
+    //-purge-cache removes the JIT's entries along with the ObjectCache's
+    ObjectCache::purge(cacheDir.str().str());
+    REQUIRE(cache.getObject(&module) == nullptr);
+
+    llvm::sys::fs::remove_directories(dir);
+}
@@ -0,0 +1,41 @@
+#include "unittest.h"
+#include "repl.h"
+#include "yyparser.h"
+#include <llvm/IR/Verifier.h>
+using namespace ante;
+using namespace llvm;
+
+/** Parse, check, and run a single line as the REPL does */
+TypedValue evalReplLine(Compiler &c, std::string line, StringMap<Variable*> &bindings){
+    setLexer(new Lexer(nullptr, line, /*line*/1, /*col*/1));
+    yy::parser p{};
+    REQUIRE(p.parse() == parser::PE_OK);
+
+    auto *root = parser::getRootNode();
+    LOC_TY loc;
+    auto *expr = new parser::ModNode(loc, Tok_Ante, nullptr);
+    expr->expr.reset(root);
+
+    auto val = mergeAndCompile(&c, root, expr, bindings);
+    if(val.type)
+        evalLine(&c, root);
+    return val;
+}
+
+TEST_CASE("REPL lines can use the variables of previous lines", "[repl]"){
+    Compiler c{nullptr};
+    c.isJIT = true;
+    StringMap<Variable*> bindings;
+
+    REQUIRE(evalReplLine(c, "x = strlen \"ab\".cStr\n", bindings).type);
+    REQUIRE(evalReplLine(c, "v = mut 5\n", bindings).type);
+    REQUIRE(evalReplLine(c, "v := v + 1\n", bindings).type);
+    REQUIRE(evalReplLine(c, "y = x + 1usz\n", bindings).type);
+
+    //each value outlives the function of the line that computed it
+    for(auto name : {"x", "v", "y"}){
+        REQUIRE(bindings.count(name));
+        REQUIRE(isa<GlobalVariable>(bindings[name]->tval.val));
+    }
+    REQUIRE_FALSE(verifyModule(*c.module, &errs()));
+}
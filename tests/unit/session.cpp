@@ -0,0 +1,33 @@
+#include "unittest.h"
+#include "module.h"
+#include <thread>
+using namespace ante;
+using namespace std;
+
+TEST_CASE("Compilation sessions are independent", "[session]"){
+    auto intTy = AnType::getIsz();
+    auto outerPtr = AnPtrType::get(intTy);
+    auto *outerRoot = &Module::getRoot();
+
+    CompilationSession session;
+    {
+        CompilationSession::Scope scope{session};
+        REQUIRE(&CompilationSession::current() == &session);
+        REQUIRE(&Module::getRoot() != outerRoot);
+        REQUIRE(errorCount() == 0);
+
+        //types are interned per session
+        auto innerPtr = AnPtrType::get(intTy);
+        REQUIRE(innerPtr != outerPtr);
+        REQUIRE(innerPtr == AnPtrType::get(intTy));
+
+        //each thread starts with its own session
+        CompilationSession *threadSession = nullptr;
+        std::thread t([&]{ threadSession = &CompilationSession::current(); });
+        t.join();
+        REQUIRE(threadSession != &session);
+    }
+
+    REQUIRE(&Module::getRoot() == outerRoot);
+    REQUIRE(AnPtrType::get(intTy) == outerPtr);
+}
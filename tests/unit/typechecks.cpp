@@ -1,6 +1,8 @@
 #include "unittest.h"
 #include "types.h"
 #include "unification.h"
+#include "module.h"
+#include "trait.h"
 using namespace ante;
 using namespace std;
 
@@ -49,6 +51,41 @@ TEST_CASE("Type Checks", "[typeEq]"){
         REQUIRE(std::find(subs.begin(), subs.end(), expected2) != subs.end());
     }
 
+    SECTION("'a = 'b, 'b = ref 'c, 'c = isz"){
+        auto a = AnTypeVarType::get("'a");
+        auto b = AnTypeVarType::get("'b");
+        auto c = AnTypeVarType::get("'c");
+        LOC_TY loc;
+
+        UnificationList unificationList;
+        TypeError noErr{"", loc};
+        unificationList.emplace_back(a, b, noErr);
+        unificationList.emplace_back(b, AnPtrType::get(c), noErr);
+        unificationList.emplace_back(c, intTy, noErr);
+        auto subs = ante::unify(unificationList);
+
+        REQUIRE(subs.size() == 3);
+        REQUIRE(subs.find(a) == subs.find(b));
+        REQUIRE(subs.find(a) != subs.find(c));
+
+        auto aPtr = try_cast<AnPtrType>(applySubstitutions(subs, a));
+        REQUIRE(aPtr != nullptr);
+        REQUIRE(aPtr->elemTy == intTy);
+    }
+
+    SECTION("'t = ref 't fails the occurs check"){
+        REQUIRE_FALSE(ante::tryUnify(t, AnPtrType::get(t)).first);
+        REQUIRE(ante::tryUnify(t, t).first);
+    }
+
+    SECTION("tryUnify keeps bindings made before a mismatch"){
+        auto pair = ante::tryUnify({t, boolTy}, {intTy, intTy});
+        REQUIRE_FALSE(pair.first);
+        REQUIRE(applySubstitutions(pair.second, t) == intTy);
+
+        REQUIRE_FALSE(ante::tryUnify({t}, {intTy, boolTy}).first);
+    }
+
     SECTION("MyType isz == MyType isz"){
         //Empty 't
         auto tvar = AnTypeVarType::get("'t");
@@ -60,7 +97,7 @@ TEST_CASE("Type Checks", "[typeEq]"){
 
         REQUIRE(mytype_isz != mytype);
 
-        //REQUIRE(mytype_isz == mytype_isz2);
+        REQUIRE(mytype_isz == mytype_isz2);
     }
 }
 
@@ -80,10 +117,74 @@ TEST_CASE("Type Uniqueness", "[typeEq]"){
 
     REQUIRE(empty != nullptr);
 
-    REQUIRE(empty_t != empty);
+    //structurally equal types are interned into one object
+    REQUIRE(empty_t == empty);
     REQUIRE(empty_t != empty_u);
 
     REQUIRE(empty_t == empty_t2);
+
+    //typevars are never interned, each is a distinct variable
+    REQUIRE(AnTypeVarType::get("'t") != AnTypeVarType::get("'t"));
+
+    auto fn = AnFunctionType::get(AnPtrType::get(t), {AnTupleType::get({t, u})}, {});
+    auto fn2 = AnFunctionType::get(AnPtrType::get(t), {AnTupleType::get({t, u})}, {});
+    REQUIRE(fn == fn2);
+    REQUIRE(fn->hash == fn2->hash);
+    REQUIRE(AnArrayType::get(t, 3) != AnArrayType::get(t, 4));
+}
+
+TEST_CASE("Trait impl lookup", "[typeEq]"){
+    auto&& c = Compiler(nullptr);
+
+    auto t = AnTypeVarType::get("'t");
+    auto intTy = AnType::getIsz();
+    auto boolTy = AnType::getBool();
+
+    auto decl = new TraitDecl("Show", {t}, {});
+    auto showPtr = new TraitImpl(decl, {AnPtrType::get(t)});
+    auto showAny = new TraitImpl(decl, {t});
+    auto showInt = new TraitImpl(decl, {intTy});
+
+    Module import{"Import"};
+    import.addTraitImpl("Show", showInt);
+
+    Module m{"Test"};
+    m.addTraitImpl("Show", showPtr);
+    m.addImport(&import);
+
+    REQUIRE(m.lookupTraitImpl("Show", {AnPtrType::get(boolTy)}) == showPtr);
+    REQUIRE(m.lookupTraitImpl("Show", {intTy}) == showInt);
+    REQUIRE(m.lookupTraitImpl("Show", {boolTy}) == nullptr);
+
+    //Impls earlier in the module take precedence, even if they are generic
+    m.addTraitImpl("Show", showAny);
+    REQUIRE(m.lookupTraitImpl("Show", {boolTy}) == showAny);
+    REQUIRE(m.lookupTraitImpl("Show", {intTy}) == showAny);
+    REQUIRE(m.lookupTraitImpl("Show", {AnPtrType::get(boolTy)}) == showPtr);
+}
+
+TEST_CASE("Monomorphisation bindings", "[typeEq]"){
+    auto&& c = Compiler(nullptr);
+
+    auto t = AnTypeVarType::get("'t");
+    auto u = AnTypeVarType::get("'u");
+    auto intTy = AnType::getIsz();
+    auto boolTy = AnType::getBool();
+
+    MonomorphisationBindings bindings;
+    bindings.bind(t, intTy);
+
+    bindings.push();
+    bindings.bind(t, boolTy);
+    bindings.bind(u, AnPtrType::get(t));
+    REQUIRE(bindings.lookup(t) == boolTy);
+    REQUIRE(bindings.apply(AnTupleType::get({t, u})) == AnTupleType::get({boolTy, AnPtrType::get(boolTy)}));
+
+    //popping a frame restores the bindings shadowed within it
+    bindings.pop();
+    REQUIRE(bindings.lookup(t) == intTy);
+    REQUIRE(bindings.lookup(u) == nullptr);
+    REQUIRE(bindings.apply(AnPtrType::get(u)) == AnPtrType::get(u));
 }
 
 /*